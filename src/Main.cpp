@@ -7,6 +7,18 @@
 #include <ADP/AnotherDangParser.hpp>
 #include "MfPA/Meter.hpp"
 #include "MfPA/GetSinkSourceInfo.hpp"
+#include "MfPA/AllocationAudit.hpp"
+
+float parseFloatOption(const std::string& opt, const char* flag)
+{
+    try {
+        return std::stof(opt);
+    } catch (const std::logic_error& e) {
+        std::cerr << "ERROR: Got invalid argument for \"" << flag << "\""
+            << std::endl;
+        std::exit(1);
+    }
+}
 
 int main(int argc, char** argv)
 {
@@ -15,6 +27,21 @@ int main(int argc, char** argv)
     unsigned int framerateLimit = 60;
     sf::Color color(sf::Color::Green);
     bool hideMarkings = false;
+    MfPA::Meter::Renderer renderer = MfPA::Meter::WINDOW;
+    bool meterApplications = false;
+    bool showVectorscope = false;
+    unsigned int vectorscopePair = 0;
+    bool lowLatency = false;
+    std::string levelServerPath;
+    bool useAnalysisPipeline = false;
+    unsigned int analysisThreads = 0;
+    bool printStageTimings = false;
+    std::string eventsTarget;
+    float statisticsWindow = 0.0f;
+    MfPA::BlackBoxRecorder::Settings blackBoxSettings;
+    MfPA::EventDetector::Thresholds thresholds;
+    MfPA::Ballistics::Mode ballisticsMode = MfPA::Ballistics::LINEAR;
+    MfPA::Scale::Type scaleType = MfPA::Scale::LINEAR;
 
     ADP::AnotherDangParser parser;
     parser.addLongOptionFlag(
@@ -107,6 +134,179 @@ int main(int argc, char** argv)
             hideMarkings = true;
         },
         "Hides the markings on the meter (default not hidden)");
+    parser.addLongFlag("terminal",
+        [&renderer] () {
+            renderer = MfPA::Meter::TERMINAL;
+        },
+        "Draws the meter in the terminal instead of a window");
+    parser.addLongFlag("headless",
+        [&renderer] () {
+            renderer = MfPA::Meter::HEADLESS;
+        },
+        "Draws nothing (use with \"--events\" or \"--level-server\")");
+    parser.addLongOptionFlag(
+        "events",
+        [&eventsTarget] (std::string opt) {
+            eventsTarget = opt;
+        },
+        "Writes silence, clip, and over threshold events to \"-\" (stdout), "
+        "\"file:PATH\", or \"unix:PATH\" (datagram socket)");
+    parser.addLongOptionFlag(
+        "silence-threshold",
+        [&thresholds] (std::string opt) {
+            thresholds.silence = parseFloatOption(opt, "--silence-threshold");
+        },
+        "Sets the silence event threshold in dBFS (default -60)");
+    parser.addLongOptionFlag(
+        "silence-hold",
+        [&thresholds] (std::string opt) {
+            thresholds.silenceHold = parseFloatOption(opt, "--silence-hold");
+        },
+        "Sets seconds below silence threshold before silence starts "
+        "(default 2)");
+    parser.addLongOptionFlag(
+        "over-threshold",
+        [&thresholds] (std::string opt) {
+            thresholds.over = parseFloatOption(opt, "--over-threshold");
+        },
+        "Sets the over threshold event threshold in dBFS (default -3)");
+    parser.addLongOptionFlag(
+        "over-hold",
+        [&thresholds] (std::string opt) {
+            thresholds.overHold = parseFloatOption(opt, "--over-hold");
+        },
+        "Sets seconds above over threshold before an over event starts "
+        "(default 0.5)");
+    parser.addLongOptionFlag(
+        "clip-threshold",
+        [&thresholds] (std::string opt) {
+            thresholds.clip = parseFloatOption(opt, "--clip-threshold");
+        },
+        "Sets the clip event threshold in dBFS (default -0.18)");
+    parser.addLongOptionFlag(
+        "hysteresis",
+        [&thresholds] (std::string opt) {
+            thresholds.hysteresis = parseFloatOption(opt, "--hysteresis");
+        },
+        "Sets dB a level must move back past a threshold to end an event "
+        "(default 3)");
+    parser.addLongOptionFlag(
+        "ballistics",
+        [&ballisticsMode] (std::string opt) {
+            if(!MfPA::Ballistics::parseMode(opt, ballisticsMode))
+            {
+                std::cerr << "ERROR: Got invalid argument for "
+                    "\"--ballistics\"" << std::endl;
+                std::exit(1);
+            }
+        },
+        "Sets the meter ballistics, one of \"linear\" (default), "
+        "\"digital\" (IEC digital peak), \"ppm1\" (IEC type I PPM), "
+        "\"ppm2\" (IEC type II PPM), or \"vu\"");
+    parser.addLongOptionFlag(
+        "scale",
+        [&scaleType] (std::string opt) {
+            if(!MfPA::Scale::parseType(opt, scaleType))
+            {
+                std::cerr << "ERROR: Got invalid argument for \"--scale\""
+                    << std::endl;
+                std::exit(1);
+            }
+        },
+        "Sets the meter scale, one of \"linear\" (default), \"db40\", "
+        "\"db60\", or \"db90\" (dB scales show levels down to -40, -60, "
+        "or -90 dBFS)");
+    parser.addLongFlag("vectorscope",
+        [&showVectorscope] () {
+            showVectorscope = true;
+        },
+        "Shows a goniometer and phase correlation of a channel pair");
+    parser.addLongOptionFlag(
+        "vectorscope-pair",
+        [&showVectorscope, &vectorscopePair] (std::string opt) {
+            try {
+                vectorscopePair = std::stoul(opt);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "ERROR: Got invalid argument for "
+                    "\"--vectorscope-pair\"" << std::endl;
+                std::exit(1);
+            }
+            showVectorscope = true;
+        },
+        "Sets the channel pair shown by the vectorscope (0 is the first two "
+        "channels, 1 the next two, etc., default 0)");
+    parser.addLongFlag("applications",
+        [&meterApplications] () {
+            meterApplications = true;
+        },
+        "Also meters every application stream as its own group of bars");
+    parser.addLongFlag("low-latency",
+        [&lowLatency] () {
+            lowLatency = true;
+        },
+        "Presents the newest levels as late as possible before each frame "
+        "and reports input to present latency");
+    parser.addLongOptionFlag(
+        "level-server",
+        [&levelServerPath] (std::string opt) {
+            levelServerPath = opt;
+        },
+        "Publishes levels to subscribers on the given Unix socket path");
+    parser.addLongOptionFlag(
+        "statistics",
+        [&statisticsWindow] (std::string opt) {
+            if(!MfPA::LevelStatistics::parseWindow(opt, statisticsWindow))
+            {
+                std::cerr << "ERROR: Got invalid argument for "
+                    "\"--statistics\"" << std::endl;
+                std::exit(1);
+            }
+        },
+        "Keeps level percentiles (p50, p95, p99, max) of every channel over "
+        "the given window (such as \"90s\", \"15m\", \"24h\", or \"7d\"), "
+        "printed on SIGUSR1 and on exit");
+    parser.addLongOptionFlag(
+        "black-box",
+        [&blackBoxSettings] (std::string opt) {
+            blackBoxSettings.directory = opt;
+        },
+        "Keeps recent audio and writes it around clips, silence, and SIGUSR2 "
+        "as WAV files to the given directory");
+    parser.addLongOptionFlag(
+        "pre-roll",
+        [&blackBoxSettings] (std::string opt) {
+            blackBoxSettings.preRoll = parseFloatOption(opt, "--pre-roll");
+        },
+        "Sets seconds recorded by the black box before a trigger (default "
+        "10)");
+    parser.addLongOptionFlag(
+        "post-roll",
+        [&blackBoxSettings] (std::string opt) {
+            blackBoxSettings.postRoll = parseFloatOption(opt, "--post-roll");
+        },
+        "Sets seconds recorded by the black box after a trigger (default 5)");
+    parser.addLongOptionFlag(
+        "analysis-threads",
+        [&useAnalysisPipeline, &analysisThreads] (std::string opt) {
+            try {
+                analysisThreads = std::stoul(opt);
+            } catch (const std::logic_error& e) {
+                std::cerr << "ERROR: Got invalid argument for "
+                    "\"--analysis-threads\"" << std::endl;
+                std::exit(1);
+            }
+            useAnalysisPipeline = true;
+        },
+        "Analyzes samples on up to the given amount of threads instead of "
+        "the drawing thread, at most one per analyzer (0 uses one per "
+        "analyzer)");
+    parser.addLongFlag("stage-timing",
+        [&useAnalysisPipeline, &printStageTimings] () {
+            useAnalysisPipeline = true;
+            printStageTimings = true;
+        },
+        "Periodically prints analysis time of every stage (implies "
+        "\"--analysis-threads 0\" unless given)");
     parser.addFlag(
         "h",
         [&parser] () {
@@ -122,14 +322,75 @@ int main(int argc, char** argv)
             << std::endl;
         return 1;
     }
+    if(renderer == MfPA::Meter::TERMINAL && eventsTarget == "-")
+    {
+        std::cerr << "ERROR: Events can't be written to stdout while it "
+            "shows the meter, use \"file:PATH\" or \"unix:PATH\""
+            << std::endl;
+        return 1;
+    }
 
     MfPA::Meter meter(
         sinkOrSourceName.c_str(),
         isSink,
         framerateLimit,
         color,
-        hideMarkings);
+        hideMarkings,
+        renderer);
+    meter.setBallistics(ballisticsMode);
+    meter.setScale(scaleType);
+    if(showVectorscope)
+    {
+        meter.enableVectorscope(vectorscopePair);
+    }
+    if(meterApplications)
+    {
+        meter.enableApplicationMetering();
+    }
+    if(lowLatency)
+    {
+        meter.enableLowLatencyPacing();
+    }
+    if(statisticsWindow > 0.0f)
+    {
+        meter.enableStatistics(statisticsWindow);
+    }
+    if(useAnalysisPipeline)
+    {
+        meter.enableAnalysisPipeline(analysisThreads, printStageTimings);
+    }
+    if(!eventsTarget.empty()
+        && !meter.enableEventDetector(eventsTarget, thresholds))
+    {
+        return 1;
+    }
+    if(!levelServerPath.empty()
+        && !meter.enableLevelServer(levelServerPath.c_str()))
+    {
+        return 1;
+    }
+    if(!blackBoxSettings.directory.empty())
+    {
+        // silence is the same as for events
+        blackBoxSettings.silenceThreshold = thresholds.silence;
+        blackBoxSettings.silenceHold = thresholds.silenceHold;
+        blackBoxSettings.hysteresis = thresholds.hysteresis;
+        if(!meter.enableBlackBox(blackBoxSettings))
+        {
+            return 1;
+        }
+    }
     meter.startMainLoop();
 
+#ifdef MFPA_ALLOCATION_AUDIT
+    if(MfPA::AllocationAudit::getSteadyStateAllocations() > 0)
+    {
+        std::cerr << "ERROR: "
+            << MfPA::AllocationAudit::getSteadyStateAllocations()
+            << " allocations after warm-up" << std::endl;
+        return 2;
+    }
+#endif
+
     return 0;
 }
@@ -0,0 +1,135 @@
+#include "AllocationAudit.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+
+namespace
+{
+
+// constant initialized, so usable by allocations during static init
+thread_local MfPA::AllocationAudit::Stage currentStage =
+    MfPA::AllocationAudit::OTHER;
+std::atomic<uint64_t> stageAllocations[MfPA::AllocationAudit::STAGE_COUNT];
+std::atomic<bool> warmedUp(false);
+std::atomic<uint64_t> steadyStateAllocations(0);
+
+const char* STAGE_NAMES[MfPA::AllocationAudit::STAGE_COUNT] = {
+    "other", "capture", "update", "draw", "analysis"
+};
+
+void* allocate(std::size_t size)
+{
+    MfPA::AllocationAudit::count();
+    void* pointer = std::malloc(size > 0 ? size : 1);
+    if(!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+} // namespace
+
+MfPA::AllocationAudit::Scope::Scope(Stage stage) :
+previous(currentStage)
+{
+    currentStage = stage;
+}
+
+MfPA::AllocationAudit::Scope::~Scope()
+{
+    currentStage = previous;
+}
+
+void MfPA::AllocationAudit::count()
+{
+    Stage stage = currentStage;
+    stageAllocations[stage].fetch_add(1, std::memory_order_relaxed);
+    if(stage != OTHER && stage != DRAW
+        && warmedUp.load(std::memory_order_relaxed))
+    {
+        steadyStateAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void MfPA::AllocationAudit::endWarmUp()
+{
+    warmedUp = true;
+}
+
+uint64_t MfPA::AllocationAudit::getSteadyStateAllocations()
+{
+    return steadyStateAllocations;
+}
+
+void MfPA::AllocationAudit::report(std::ostream& stream)
+{
+    // read everything first, so allocations made while printing are
+    // counted in the next report
+    uint64_t allocations[STAGE_COUNT];
+    for(unsigned int i = 0; i < STAGE_COUNT; ++i)
+    {
+        allocations[i] = stageAllocations[i].exchange(0);
+    }
+
+    stream << "Allocations:";
+    for(unsigned int i = 0; i < STAGE_COUNT; ++i)
+    {
+        stream << " " << STAGE_NAMES[i] << " " << allocations[i];
+    }
+    stream << std::endl;
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    MfPA::AllocationAudit::count();
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    MfPA::AllocationAudit::count();
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
@@ -0,0 +1,63 @@
+#ifndef ALLOCATION_AUDIT_HPP
+#define ALLOCATION_AUDIT_HPP
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace MfPA
+{
+
+/*
+ * Counts heap allocations made through operator new, by the stage the
+ * allocating thread is in.
+ *
+ * Only available when built with MFPA_ALLOCATION_AUDIT, which replaces the
+ * global allocation functions. Allocations made with malloc directly (such
+ * as inside libpulse) are not counted.
+ */
+class AllocationAudit
+{
+public:
+    enum Stage
+    {
+        // anything not in a stage below, such as startup, reports, and
+        // streams and subscribers coming and going
+        OTHER,
+        // pulseaudio read callbacks
+        CAPTURE,
+        UPDATE,
+        DRAW,
+        // threads of the analysis pipeline
+        ANALYSIS,
+        STAGE_COUNT
+    };
+
+    // sets the stage of the calling thread until destroyed
+    class Scope
+    {
+    public:
+        Scope(Stage stage);
+        ~Scope();
+
+    private:
+        Stage previous;
+    };
+
+    // called by the replaced allocation functions
+    static void count();
+
+    // allocations in CAPTURE, UPDATE and ANALYSIS are counted as steady
+    // state allocations from now on. DRAW is only reported, since drawing a
+    // window goes through SFML and the graphics driver, whose allocations
+    // aren't ours to avoid
+    static void endWarmUp();
+    static uint64_t getSteadyStateAllocations();
+
+    // prints allocations of every stage since the previous report
+    static void report(std::ostream& stream);
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,231 @@
+#include "AnalysisPipeline.hpp"
+
+#include <chrono>
+#include <ostream>
+
+#include "AllocationAudit.hpp"
+
+MfPA::AnalysisPipeline::StageTiming::StageTiming() :
+name(""),
+nanoseconds(0),
+blocks(0)
+{}
+
+MfPA::AnalysisPipeline::AnalysisPipeline() :
+chain(nullptr),
+channels(0),
+running(false),
+queueHead(0),
+queueTail(0),
+nextBlock(0),
+stageCount(0),
+droppedBlocks(0)
+{}
+
+MfPA::AnalysisPipeline::~AnalysisPipeline()
+{
+    stop();
+}
+
+void MfPA::AnalysisPipeline::start(
+    unsigned int threads,
+    AnalyzerChain* chain,
+    unsigned char channels)
+{
+    stop();
+
+    this->chain = chain;
+    this->channels = channels;
+
+    const auto& analyzers = chain->getAnalyzers();
+    if(analyzers.empty())
+    {
+        return;
+    }
+    stageCount = analyzers.size();
+    stageTimings.reset(new StageTiming[stageCount]);
+    stageBlocks.reset(new std::size_t[stageCount]);
+    for(unsigned int stage = 0; stage < stageCount; ++stage)
+    {
+        stageTimings[stage].name = analyzers[stage]->getName();
+        stageBlocks[stage] = queueHead.load(std::memory_order_relaxed);
+    }
+    nextBlock = queueHead.load(std::memory_order_relaxed);
+
+    // blocks wait for each other at every analyzer, so at most one thread
+    // per analyzer does work at a time
+    if(threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    if(threads > stageCount)
+    {
+        threads = stageCount;
+    }
+    if(threads == 0)
+    {
+        threads = 1;
+    }
+
+    running = true;
+    for(unsigned int i = 0; i < threads; ++i)
+    {
+        this->threads.emplace_back(&AnalysisPipeline::analyze, this);
+    }
+}
+
+void MfPA::AnalysisPipeline::stop()
+{
+    if(threads.empty())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> blockLock(blockMutex);
+        std::lock_guard<std::mutex> stageLock(stageMutex);
+        running = false;
+    }
+    blockCondition.notify_all();
+    stageCondition.notify_all();
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    threads.clear();
+
+    // blocks taken but not finished are dropped, so a restart begins at
+    // the tail
+    queueHead.store(
+        queueTail.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+}
+
+bool MfPA::AnalysisPipeline::isRunning() const
+{
+    return !threads.empty();
+}
+
+unsigned int MfPA::AnalysisPipeline::getThreads() const
+{
+    return threads.size();
+}
+
+bool MfPA::AnalysisPipeline::push(const float* samples, std::size_t count)
+{
+    std::size_t tail = queueTail.load(std::memory_order_relaxed);
+    if(tail - queueHead.load(std::memory_order_acquire)
+        >= ANALYSIS_PIPELINE_QUEUE_SIZE)
+    {
+        droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // every slot is used once the queue went around, after which buffers
+    // only grow for larger blocks
+    queue[tail % ANALYSIS_PIPELINE_QUEUE_SIZE].assign(samples, samples + count);
+    queueTail.store(tail + 1, std::memory_order_release);
+
+    // empty critical section so the wakeup can't fall between a thread's
+    // check and its wait
+    {
+        std::lock_guard<std::mutex> lock(blockMutex);
+    }
+    blockCondition.notify_one();
+    return true;
+}
+
+void MfPA::AnalysisPipeline::printStageTimings(std::ostream& stream)
+{
+    stream << "Analysis time per block on " << threads.size() << " threads:";
+    for(unsigned int i = 0; i < stageCount; ++i)
+    {
+        uint64_t nanoseconds = stageTimings[i].nanoseconds.exchange(0);
+        uint64_t blocks = stageTimings[i].blocks.exchange(0);
+        if(blocks > 0)
+        {
+            stream << " " << stageTimings[i].name << " "
+                << (float)nanoseconds / (float)blocks / 1000.0f << " us";
+        }
+    }
+    stream << ", dropped blocks " << droppedBlocks.exchange(0) << std::endl;
+}
+
+void MfPA::AnalysisPipeline::analyze()
+{
+#ifdef MFPA_ALLOCATION_AUDIT
+    AllocationAudit::Scope auditScope(AllocationAudit::ANALYSIS);
+#endif
+    const auto& analyzers = chain->getAnalyzers();
+
+    std::size_t block;
+    while(takeBlock(block))
+    {
+        const std::vector<float>& samples =
+            queue[block % ANALYSIS_PIPELINE_QUEUE_SIZE];
+        std::size_t frames = channels > 0 ? samples.size() / channels : 0;
+
+        for(unsigned int stage = 0; stage < stageCount; ++stage)
+        {
+            if(!waitForStage(stage, block))
+            {
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            analyzers[stage]->process(samples.data(), frames, channels);
+            analyzers[stage]->publish();
+            stageTimings[stage].nanoseconds.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count(),
+                std::memory_order_relaxed);
+            stageTimings[stage].blocks.fetch_add(
+                1, std::memory_order_relaxed);
+
+            finishStage(stage, block);
+        }
+    }
+}
+
+bool MfPA::AnalysisPipeline::takeBlock(std::size_t& block)
+{
+    std::unique_lock<std::mutex> lock(blockMutex);
+    blockCondition.wait(lock, [this] () {
+        return !running
+            || nextBlock != queueTail.load(std::memory_order_acquire);
+    });
+    if(!running)
+    {
+        return false;
+    }
+    block = nextBlock++;
+    return true;
+}
+
+bool MfPA::AnalysisPipeline::waitForStage(
+    unsigned int stage,
+    std::size_t block)
+{
+    std::unique_lock<std::mutex> lock(stageMutex);
+    stageCondition.wait(lock, [this, stage, block] () {
+        return !running || stageBlocks[stage] == block;
+    });
+    return running;
+}
+
+void MfPA::AnalysisPipeline::finishStage(
+    unsigned int stage,
+    std::size_t block)
+{
+    {
+        std::lock_guard<std::mutex> lock(stageMutex);
+        stageBlocks[stage] = block + 1;
+        // blocks leave the last stage in order, after which the slot can be
+        // reused
+        if(stage + 1 == stageCount)
+        {
+            queueHead.store(block + 1, std::memory_order_release);
+        }
+    }
+    stageCondition.notify_all();
+}
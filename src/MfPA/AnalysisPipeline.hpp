@@ -0,0 +1,105 @@
+#ifndef ANALYSIS_PIPELINE_HPP
+#define ANALYSIS_PIPELINE_HPP
+
+// blocks that can wait for analysis, newer blocks are dropped when full
+#define ANALYSIS_PIPELINE_QUEUE_SIZE 64
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Analyzer.hpp"
+
+namespace MfPA
+{
+
+/*
+ * Runs an analyzer chain over captured blocks on a pool of threads, off the
+ * thread that captures and draws.
+ *
+ * Each thread takes the next queued block and runs the whole chain over it,
+ * so a block is only touched by one core. Every analysis depends on the
+ * previous block, so an analyzer only starts on a block once it finished
+ * the one before. Blocks move through the chain one behind another, and with
+ * several analyzers as many blocks are analyzed at once, each by a
+ * different analyzer. Threads waiting for a block or an analyzer sleep on a
+ * condition variable. Every analyzer publishes its results once it finished
+ * a block, which other threads read without locking.
+ */
+class AnalysisPipeline
+{
+public:
+    AnalysisPipeline();
+    ~AnalysisPipeline();
+
+    // analyzers must be configured and are only used by the pipeline until
+    // stop, threads of 0 uses one per analyzer up to one per core, more
+    // threads than analyzers are never used
+    void start(
+        unsigned int threads,
+        AnalyzerChain* chain,
+        unsigned char channels);
+    void stop();
+    bool isRunning() const;
+    unsigned int getThreads() const;
+
+    // samples are interleaved samples of all channels, copied into a
+    // reused buffer, returns false if the queue is full and the block was
+    // dropped
+    bool push(const float* samples, std::size_t count);
+
+    // prints average time of every stage per block since the last call
+    void printStageTimings(std::ostream& stream);
+
+private:
+    struct StageTiming
+    {
+        StageTiming();
+
+        const char* name;
+        std::atomic<uint64_t> nanoseconds;
+        std::atomic<uint64_t> blocks;
+    };
+
+    AnalyzerChain* chain;
+    unsigned char channels;
+
+    std::vector<std::thread> threads;
+    std::atomic<bool> running;
+
+    // ring of blocks filled by one producer, a slot is reused once the last
+    // analyzer finished its block
+    std::vector<float> queue[ANALYSIS_PIPELINE_QUEUE_SIZE];
+    std::atomic<std::size_t> queueHead;
+    std::atomic<std::size_t> queueTail;
+    // next block a thread takes
+    std::size_t nextBlock;
+    std::mutex blockMutex;
+    std::condition_variable blockCondition;
+
+    // one stage per analyzer, holding the block it may analyze next
+    std::unique_ptr<std::size_t[]> stageBlocks;
+    std::mutex stageMutex;
+    std::condition_variable stageCondition;
+
+    std::unique_ptr<StageTiming[]> stageTimings;
+    unsigned int stageCount;
+    std::atomic<uint64_t> droppedBlocks;
+
+    void analyze();
+    // false once stopping
+    bool takeBlock(std::size_t& block);
+    bool waitForStage(unsigned int stage, std::size_t block);
+    void finishStage(unsigned int stage, std::size_t block);
+
+};
+
+} // namespace MfPA
+
+#endif
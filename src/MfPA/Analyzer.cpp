@@ -0,0 +1,38 @@
+#include "Analyzer.hpp"
+
+MfPA::Analyzer::~Analyzer()
+{}
+
+void MfPA::AnalyzerChain::add(Analyzer* analyzer)
+{
+    analyzers.push_back(analyzer);
+}
+
+void MfPA::AnalyzerChain::clear()
+{
+    analyzers.clear();
+}
+
+const std::vector<MfPA::Analyzer*>& MfPA::AnalyzerChain::getAnalyzers() const
+{
+    return analyzers;
+}
+
+void MfPA::AnalyzerChain::process(
+    const float* samples,
+    std::size_t frames,
+    unsigned char channels)
+{
+    for(Analyzer* analyzer : analyzers)
+    {
+        analyzer->process(samples, frames, channels);
+    }
+}
+
+void MfPA::AnalyzerChain::publish()
+{
+    for(Analyzer* analyzer : analyzers)
+    {
+        analyzer->publish();
+    }
+}
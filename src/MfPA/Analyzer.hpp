@@ -0,0 +1,65 @@
+#ifndef ANALYZER_HPP
+#define ANALYZER_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace MfPA
+{
+
+/*
+ * Something computed from every captured block, such as peaks or
+ * correlation.
+ *
+ * Each analyzer publishes a fixed size result (see TripleBuffer), so
+ * renderers and exporters on any thread can read the newest results
+ * without knowing who analyzes.
+ */
+class Analyzer
+{
+public:
+    virtual ~Analyzer();
+
+    // name shown in timings
+    virtual const char* getName() const = 0;
+
+    // samples are "frames" interleaved frames of "channels" channels
+    virtual void process(
+        const float* samples,
+        std::size_t frames,
+        unsigned char channels) = 0;
+
+    // makes results of every block processed so far readable, called once
+    // per block after it was processed, on the same thread
+    virtual void publish() = 0;
+
+};
+
+/*
+ * Analyzers run in order over each block on one thread, so the block is
+ * read from memory once and is still in that core's cache for every
+ * analyzer after the first.
+ */
+class AnalyzerChain
+{
+public:
+    // analyzers are owned by the caller
+    void add(Analyzer* analyzer);
+    void clear();
+    const std::vector<Analyzer*>& getAnalyzers() const;
+
+    // every analyzer over all channels of the block
+    void process(
+        const float* samples,
+        std::size_t frames,
+        unsigned char channels);
+    void publish();
+
+private:
+    std::vector<Analyzer*> analyzers;
+
+};
+
+} // namespace MfPA
+
+#endif
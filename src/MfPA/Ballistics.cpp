@@ -0,0 +1,223 @@
+#include "Ballistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// coefficient of a one pole filter reaching "fraction" of a step in "time"
+float riseCoefficient(float time, float fraction, unsigned int sampleRate)
+{
+    float tau = -time / std::log(1.0f - fraction);
+    return 1.0f - std::exp(-1.0f / (tau * sampleRate));
+}
+
+// multiplier falling "decibels" in "time" when applied every sample
+float fallCoefficient(float decibels, float time, unsigned int sampleRate)
+{
+    return std::pow(10.0f, -decibels / 20.0f / (time * sampleRate));
+}
+
+} // namespace
+
+MfPA::Ballistics::Ballistics(Mode mode) :
+mode(mode),
+sampleRate(48000),
+channels(0)
+{
+    configure(sampleRate, channels);
+}
+
+bool MfPA::Ballistics::parseMode(const std::string& name, Mode& mode)
+{
+    if(name == "linear")
+    {
+        mode = LINEAR;
+    }
+    else if(name == "digital")
+    {
+        mode = DIGITAL_PEAK;
+    }
+    else if(name == "ppm1")
+    {
+        mode = PPM_TYPE_I;
+    }
+    else if(name == "ppm2")
+    {
+        mode = PPM_TYPE_II;
+    }
+    else if(name == "vu")
+    {
+        mode = VU;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void MfPA::Ballistics::setMode(Mode mode)
+{
+    this->mode = mode;
+    updateCoefficients();
+}
+
+void MfPA::Ballistics::configure(
+    unsigned int sampleRate,
+    unsigned char channels)
+{
+    this->sampleRate = sampleRate > 0 ? sampleRate : 1;
+    this->channels = std::min<unsigned char>(channels, BALLISTICS_MAX_CHANNELS);
+    for(unsigned int i = 0; i < BALLISTICS_MAX_CHANNELS; ++i)
+    {
+        levels[i] = 0.0f;
+        holds[i] = 0.0f;
+        holdRemaining[i] = 0.0f;
+        peaks[i] = 0.0f;
+    }
+    updateCoefficients();
+}
+
+void MfPA::Ballistics::process(const float* samples, std::size_t frames)
+{
+    switch(mode)
+    {
+    case LINEAR:
+        processBlock<LINEAR>(samples, frames);
+        break;
+    case DIGITAL_PEAK:
+        processBlock<DIGITAL_PEAK>(samples, frames);
+        break;
+    case PPM_TYPE_I:
+        processBlock<PPM_TYPE_I>(samples, frames);
+        break;
+    case PPM_TYPE_II:
+        processBlock<PPM_TYPE_II>(samples, frames);
+        break;
+    case VU:
+        processBlock<VU>(samples, frames);
+        break;
+    }
+}
+
+unsigned char MfPA::Ballistics::getChannels() const
+{
+    return channels;
+}
+
+const float* MfPA::Ballistics::getLevels() const
+{
+    return levels;
+}
+
+const float* MfPA::Ballistics::getHolds() const
+{
+    return holds;
+}
+
+const float* MfPA::Ballistics::getHoldRemaining() const
+{
+    return holdRemaining;
+}
+
+const float* MfPA::Ballistics::getPeaks() const
+{
+    return peaks;
+}
+
+void MfPA::Ballistics::resetPeaks()
+{
+    for(unsigned int i = 0; i < BALLISTICS_MAX_CHANNELS; ++i)
+    {
+        peaks[i] = 0.0f;
+    }
+}
+
+void MfPA::Ballistics::updateCoefficients()
+{
+    attack = 1.0f;
+    release = 1.0f;
+    linearRelease = BALLISTICS_LINEAR_DECAY_RATE / sampleRate;
+    holdDecrement = 1.0f / (BALLISTICS_HOLD_TIME * sampleRate);
+
+    switch(mode)
+    {
+    case LINEAR:
+        break;
+    case DIGITAL_PEAK:
+        release = fallCoefficient(20.0f, 1.7f, sampleRate);
+        break;
+    case PPM_TYPE_I:
+        attack = riseCoefficient(0.01f, 0.891f, sampleRate);
+        release = fallCoefficient(20.0f, 1.5f, sampleRate);
+        break;
+    case PPM_TYPE_II:
+        attack = riseCoefficient(0.01f, 0.75f, sampleRate);
+        release = fallCoefficient(24.0f, 2.8f, sampleRate);
+        break;
+    case VU:
+        attack = riseCoefficient(0.3f, 0.99f, sampleRate);
+        release = attack;
+        break;
+    }
+}
+
+template <MfPA::Ballistics::Mode M>
+void MfPA::Ballistics::processBlock(const float* samples, std::size_t frames)
+{
+    // VU integrates the rectified average, pi/2 makes a sine read its peak
+    const float scale = M == VU ? 1.5707964f : 1.0f;
+    const unsigned int channels = this->channels;
+    const float attack = this->attack;
+    const float release = this->release;
+    const float linearRelease = this->linearRelease;
+    const float holdDecrement = this->holdDecrement;
+    float* levels = this->levels;
+    float* holds = this->holds;
+    float* holdRemaining = this->holdRemaining;
+    float* peaks = this->peaks;
+
+    for(std::size_t frame = 0; frame < frames; ++frame)
+    {
+        const float* current = samples + frame * channels;
+        // only selects, no branches, so the loop over channels vectorizes
+        for(unsigned int i = 0; i < channels; ++i)
+        {
+            float sample = std::abs(current[i]);
+            peaks[i] = std::max(peaks[i], sample);
+            float x = sample * scale;
+            float level = levels[i];
+            switch(M)
+            {
+            case LINEAR:
+                level = std::max(x, std::max(level - linearRelease, 0.0f));
+                break;
+            case DIGITAL_PEAK:
+                level = std::max(x, level * release);
+                break;
+            case PPM_TYPE_I:
+            case PPM_TYPE_II:
+                level = x > level
+                    ? level + attack * (x - level)
+                    : level * release;
+                break;
+            case VU:
+                level += attack * (x - level);
+                break;
+            }
+            level = level < BALLISTICS_FLUSH_LEVEL ? 0.0f : level;
+            levels[i] = level;
+
+            float hold = holds[i];
+            float remaining = holdRemaining[i] - holdDecrement;
+            bool hit = level >= hold;
+            hold = hit ? level : hold;
+            remaining = hit ? 1.0f : remaining;
+            bool expired = remaining <= 0.0f;
+            holds[i] = expired ? 0.0f : hold;
+            holdRemaining[i] = expired ? 0.0f : remaining;
+        }
+    }
+}
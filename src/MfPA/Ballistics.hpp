@@ -0,0 +1,92 @@
+#ifndef BALLISTICS_HPP
+#define BALLISTICS_HPP
+
+#define BALLISTICS_MAX_CHANNELS 32
+// amplitude fall per second of LINEAR mode
+#define BALLISTICS_LINEAR_DECAY_RATE 2.0f
+// seconds a peak is held before it is reset
+#define BALLISTICS_HOLD_TIME 1.0f
+// levels below this amplitude (-200 dBFS) are flushed to zero, decaying
+// further would end in subnormals which are many times slower to compute
+#define BALLISTICS_FLUSH_LEVEL 1e-10f
+
+#include <cstddef>
+#include <string>
+
+namespace MfPA
+{
+
+/*
+ * Integrates interleaved float samples into meter levels, one sample at a
+ * time so the result does not depend on block size or frame rate.
+ *
+ * State is kept as one array per quantity so the inner loop over channels
+ * can be vectorized.
+ */
+class Ballistics
+{
+public:
+    enum Mode
+    {
+        // instant attack, linear amplitude fall (previous behavior)
+        LINEAR,
+        // IEC 60268-18 digital peak, instant attack, 20 dB fall in 1.7 s
+        DIGITAL_PEAK,
+        // IEC 60268-10 type I (DIN), 10 ms burst reads -1 dB,
+        // 20 dB fall in 1.5 s
+        PPM_TYPE_I,
+        // IEC 60268-10 type II (BBC), 10 ms burst reads -2.5 dB,
+        // 24 dB fall in 2.8 s
+        PPM_TYPE_II,
+        // IEC 60268-17 VU, rectified average reaching 99% in 300 ms,
+        // scaled so a sine reads its amplitude
+        VU
+    };
+
+    Ballistics(Mode mode = LINEAR);
+
+    // returns false if name does not match any mode
+    static bool parseMode(const std::string& name, Mode& mode);
+
+    void setMode(Mode mode);
+    // resets levels
+    void configure(unsigned int sampleRate, unsigned char channels);
+
+    void process(const float* samples, std::size_t frames);
+
+    unsigned char getChannels() const;
+    // current meter reading as linear amplitude
+    const float* getLevels() const;
+    // held maximum reading as linear amplitude
+    const float* getHolds() const;
+    // remaining fraction of hold time, 1 when hold was last set
+    const float* getHoldRemaining() const;
+    // largest absolute sample since last resetPeaks()
+    const float* getPeaks() const;
+    void resetPeaks();
+
+private:
+    Mode mode;
+    unsigned int sampleRate;
+    unsigned char channels;
+
+    // per sample integration coefficients
+    float attack;
+    float release;
+    float linearRelease;
+    float holdDecrement;
+
+    float levels[BALLISTICS_MAX_CHANNELS];
+    float holds[BALLISTICS_MAX_CHANNELS];
+    float holdRemaining[BALLISTICS_MAX_CHANNELS];
+    float peaks[BALLISTICS_MAX_CHANNELS];
+
+    void updateCoefficients();
+    template <Mode M>
+    void processBlock(const float* samples, std::size_t frames);
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,406 @@
+#include "BlackBoxRecorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+
+namespace
+{
+
+void putUint16(unsigned char* bytes, uint16_t value)
+{
+    bytes[0] = value & 0xFF;
+    bytes[1] = value >> 8;
+}
+
+void putUint32(unsigned char* bytes, uint32_t value)
+{
+    putUint16(bytes, value & 0xFFFF);
+    putUint16(bytes + 2, value >> 16);
+}
+
+// RIFF sizes are 32 bit, longer recordings still play up to the limit
+uint32_t clampSize(uint64_t size)
+{
+    return size > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)size;
+}
+
+} // namespace
+
+MfPA::BlackBoxRecorder::Settings::Settings() :
+preRoll(10.0f),
+postRoll(5.0f),
+clipLevel(0.98f),
+silenceThreshold(-60.0f),
+silenceHold(2.0f),
+hysteresis(3.0f)
+{}
+
+MfPA::BlackBoxRecorder::BlackBoxRecorder() :
+opened(false),
+sampleRate(1),
+channels(0),
+capacity(0),
+writtenFrames(0),
+silenceLevel(0.0f),
+silenceEndLevel(0.0f),
+silentTime(0.0f),
+silent(false),
+clipping(false),
+triggerRequested(false),
+recordingPending(false),
+recordings(0),
+truncatedRecordings(0),
+stopping(false),
+sequence(0)
+{}
+
+MfPA::BlackBoxRecorder::~BlackBoxRecorder()
+{
+    stopWriter();
+}
+
+bool MfPA::BlackBoxRecorder::open(const Settings& settings)
+{
+    if(access(settings.directory.c_str(), W_OK) != 0)
+    {
+        std::cerr << "ERROR: Black box directory \"" << settings.directory
+            << "\" is not writable, " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if(settings.preRoll < 0.0f || settings.postRoll < 0.0f)
+    {
+        std::cerr << "ERROR: Black box pre-roll and post-roll must not be "
+            "negative" << std::endl;
+        return false;
+    }
+
+    this->settings = settings;
+    silenceLevel = std::pow(10.0f, settings.silenceThreshold / 20.0f);
+    silenceEndLevel = std::pow(
+        10.0f, (settings.silenceThreshold + settings.hysteresis) / 20.0f);
+    opened = true;
+    return true;
+}
+
+bool MfPA::BlackBoxRecorder::isOpen() const
+{
+    return opened;
+}
+
+void MfPA::BlackBoxRecorder::configure(
+    unsigned int sampleRate,
+    unsigned char channels)
+{
+    stopWriter();
+
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    capacity = (std::size_t)(
+        (settings.preRoll + BLACK_BOX_RECORDER_SLACK) * sampleRate) + 1;
+    ring.reset(new float[capacity * channels]());
+    writeBuffer.reset(new float[BLACK_BOX_RECORDER_WRITE_FRAMES * channels]);
+    writtenFrames = 0;
+    silentTime = 0.0f;
+    silent = false;
+    clipping = false;
+    recordingPending = false;
+
+    stopping = false;
+    writer = std::thread(&BlackBoxRecorder::writeRecordings, this);
+}
+
+void MfPA::BlackBoxRecorder::requestTrigger()
+{
+    triggerRequested = true;
+}
+
+const char* MfPA::BlackBoxRecorder::getName() const
+{
+    return "black box";
+}
+
+void MfPA::BlackBoxRecorder::process(
+    const float* samples,
+    std::size_t frames,
+    unsigned char /* channels */)
+{
+    if(!ring || frames == 0)
+    {
+        return;
+    }
+
+    // a writer that fell behind gives up on frames instead of capture
+    // waiting for it
+    uint64_t written = writtenFrames.load(std::memory_order_relaxed);
+    std::size_t copied = 0;
+    while(copied < frames)
+    {
+        std::size_t index = (written + copied) % capacity;
+        std::size_t count = std::min(frames - copied, capacity - index);
+        std::copy(
+            samples + copied * channels,
+            samples + (copied + count) * channels,
+            ring.get() + index * channels);
+        copied += count;
+    }
+    written += frames;
+    writtenFrames.store(written, std::memory_order_release);
+
+    float peak = 0.0f;
+    for(std::size_t i = 0; i < frames * channels; ++i)
+    {
+        peak = std::max(peak, std::abs(samples[i]));
+    }
+
+    // clips and silence trigger once when they start
+    bool clipped = peak >= settings.clipLevel;
+    if(clipped && !clipping)
+    {
+        startRecording(CLIP, written);
+    }
+    clipping = clipped;
+
+    // like EventDetector, silence only ends above the hysteresis
+    if(!silent)
+    {
+        silentTime = peak < silenceLevel
+            ? silentTime + (float)frames / (float)sampleRate : 0.0f;
+        if(silentTime >= settings.silenceHold)
+        {
+            silent = true;
+            startRecording(SILENCE, written);
+        }
+    }
+    else if(peak > silenceEndLevel)
+    {
+        silent = false;
+        silentTime = 0.0f;
+    }
+
+    if(triggerRequested.load(std::memory_order_relaxed)
+        && triggerRequested.exchange(false))
+    {
+        startRecording(REQUEST, written);
+    }
+}
+
+void MfPA::BlackBoxRecorder::publish()
+{}
+
+unsigned long MfPA::BlackBoxRecorder::getRecordings() const
+{
+    return recordings;
+}
+
+unsigned long MfPA::BlackBoxRecorder::getTruncatedRecordings() const
+{
+    return truncatedRecordings;
+}
+
+const char* MfPA::BlackBoxRecorder::getTriggerName(Trigger trigger)
+{
+    switch(trigger)
+    {
+    case CLIP:
+        return "clip";
+    case SILENCE:
+        return "silence";
+    case REQUEST:
+        return "request";
+    }
+    return "unknown";
+}
+
+void MfPA::BlackBoxRecorder::startRecording(Trigger trigger, uint64_t frame)
+{
+    if(recordingPending.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    uint64_t preRollFrames = (uint64_t)(settings.preRoll * sampleRate);
+    recording.trigger = trigger;
+    recording.time = std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now());
+    recording.startFrame = frame > preRollFrames ? frame - preRollFrames : 0;
+    recording.endFrame = frame + (uint64_t)(settings.postRoll * sampleRate);
+    recordingPending.store(true, std::memory_order_release);
+}
+
+void MfPA::BlackBoxRecorder::stopWriter()
+{
+    if(!writer.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        stopping = true;
+    }
+    writerCondition.notify_all();
+    writer.join();
+}
+
+void MfPA::BlackBoxRecorder::writeRecordings()
+{
+    while(waitForSamples())
+    {
+        if(recordingPending.load(std::memory_order_acquire))
+        {
+            writeRecording();
+        }
+    }
+
+    // finish a recording in progress with what was captured
+    if(recordingPending.load(std::memory_order_acquire))
+    {
+        writeRecording();
+    }
+}
+
+void MfPA::BlackBoxRecorder::writeRecording()
+{
+    std::tm utc;
+    gmtime_r(&recording.time, &utc);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%SZ", &utc);
+    char path[4096];
+    std::snprintf(path, sizeof(path), "%s/blackbox-%s-%lu-%s.wav",
+        settings.directory.c_str(),
+        timestamp,
+        ++sequence,
+        getTriggerName(recording.trigger));
+
+    std::FILE* file = std::fopen(path, "wb");
+    if(!file)
+    {
+        std::cerr << "ERROR: Failed to open black box recording \"" << path
+            << "\", " << std::strerror(errno) << std::endl;
+        recordingPending.store(false, std::memory_order_release);
+        return;
+    }
+
+    // frames this close to being overwritten are given up on, the only
+    // thing keeping capture from writing over frames while they are copied
+    const uint64_t guardFrames =
+        (uint64_t)(BLACK_BOX_RECORDER_SLACK / 2.0f * sampleRate);
+    bool failed = !writeHeader(file, 0);
+    bool truncated = false;
+    uint64_t position = recording.startFrame;
+    while(!failed && position < recording.endFrame)
+    {
+        uint64_t written = writtenFrames.load(std::memory_order_acquire);
+        if(written + guardFrames > position + capacity)
+        {
+            truncated = true;
+            break;
+        }
+        uint64_t available = std::min(written, recording.endFrame);
+        if(available <= position)
+        {
+            if(!waitForSamples())
+            {
+                break;
+            }
+            continue;
+        }
+
+        std::size_t count = std::min(
+            available - position,
+            (uint64_t)BLACK_BOX_RECORDER_WRITE_FRAMES);
+        for(std::size_t copied = 0; copied < count; )
+        {
+            std::size_t index = (position + copied) % capacity;
+            std::size_t part = std::min(count - copied, capacity - index);
+            std::copy(
+                ring.get() + index * channels,
+                ring.get() + (index + part) * channels,
+                writeBuffer.get() + copied * channels);
+            copied += part;
+        }
+        // capture got closer than the margin during the copy, the frames
+        // may have been overwritten
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(writtenFrames.load(std::memory_order_relaxed) > position + capacity)
+        {
+            truncated = true;
+            break;
+        }
+        if(std::fwrite(writeBuffer.get(), sizeof(float) * channels, count, file)
+            != count)
+        {
+            failed = true;
+            break;
+        }
+        position += count;
+    }
+
+    uint64_t frames = position - recording.startFrame;
+    failed = failed
+        || std::fseek(file, 0, SEEK_SET) != 0
+        || !writeHeader(file, frames);
+    failed = std::fclose(file) != 0 || failed;
+    if(failed)
+    {
+        std::cerr << "ERROR: Failed to write black box recording \"" << path
+            << "\", " << std::strerror(errno) << std::endl;
+    }
+    else
+    {
+        ++recordings;
+        if(truncated)
+        {
+            ++truncatedRecordings;
+        }
+        std::cout << "Recorded " << getTriggerName(recording.trigger)
+            << " to \"" << path << "\""
+            << (truncated ? " (cut short, writing fell behind)" : "")
+            << std::endl;
+    }
+    recordingPending.store(false, std::memory_order_release);
+}
+
+bool MfPA::BlackBoxRecorder::waitForSamples()
+{
+    std::unique_lock<std::mutex> lock(writerMutex);
+    writerCondition.wait_for(
+        lock,
+        std::chrono::duration<float>(BLACK_BOX_RECORDER_WRITER_INTERVAL),
+        [this] () { return stopping; });
+    return !stopping;
+}
+
+bool MfPA::BlackBoxRecorder::writeHeader(
+    std::FILE* file,
+    uint64_t frames) const
+{
+    // WAVE_FORMAT_IEEE_FLOAT, which needs the extended fmt chunk and a fact
+    // chunk
+    uint64_t dataSize = frames * channels * sizeof(float);
+    unsigned char header[58];
+    std::memcpy(header, "RIFF", 4);
+    putUint32(header + 4, clampSize(sizeof(header) - 8 + dataSize));
+    std::memcpy(header + 8, "WAVE", 4);
+    std::memcpy(header + 12, "fmt ", 4);
+    putUint32(header + 16, 18);
+    putUint16(header + 20, 3);
+    putUint16(header + 22, channels);
+    putUint32(header + 24, sampleRate);
+    putUint32(header + 28, sampleRate * channels * sizeof(float));
+    putUint16(header + 32, channels * sizeof(float));
+    putUint16(header + 34, 32);
+    putUint16(header + 36, 0);
+    std::memcpy(header + 38, "fact", 4);
+    putUint32(header + 42, 4);
+    putUint32(header + 46, clampSize(frames));
+    std::memcpy(header + 50, "data", 4);
+    putUint32(header + 54, clampSize(dataSize));
+    return std::fwrite(header, sizeof(header), 1, file) == 1;
+}
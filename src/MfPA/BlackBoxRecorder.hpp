@@ -0,0 +1,163 @@
+#ifndef BLACK_BOX_RECORDER_HPP
+#define BLACK_BOX_RECORDER_HPP
+
+// seconds of audio kept beyond the pre-roll, time the writer has to copy a
+// recording out of the ring before capture overwrites it, half of it is kept
+// as a margin between the frames copied and the frames captured
+#define BLACK_BOX_RECORDER_SLACK 2.0f
+// seconds the writer waits when no new samples are available
+#define BLACK_BOX_RECORDER_WRITER_INTERVAL 0.05f
+// frames copied out of the ring per write
+#define BLACK_BOX_RECORDER_WRITE_FRAMES 4096
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Analyzer.hpp"
+
+namespace MfPA
+{
+
+/*
+ * Keeps the last seconds of captured audio in a ring allocated up front,
+ * and on a clip, the start of silence, or a request writes the audio around
+ * it to a float WAV file.
+ *
+ * Analysis only copies samples into the ring and hands a trigger to a
+ * writer thread, which streams pre-roll and then post-roll from the ring to
+ * disk as it is captured, so capture never waits on disk and memory only
+ * depends on the pre-roll. A recording the writer can't keep up with is cut
+ * short instead of delaying capture. Triggers while a recording is being
+ * written are ignored.
+ *
+ * Capture never waits for the writer, and nothing but a margin keeps them
+ * apart: the writer only copies frames that capture is at least half the
+ * slack (1 second) away from overwriting, and checks again after copying,
+ * cutting the recording short if capture came closer meanwhile.
+ */
+class BlackBoxRecorder : public Analyzer
+{
+public:
+    enum Trigger
+    {
+        CLIP,
+        SILENCE,
+        REQUEST
+    };
+
+    struct Settings
+    {
+        Settings();
+
+        // recordings are written here
+        std::string directory;
+        // seconds before and after a trigger
+        float preRoll;
+        float postRoll;
+        // linear amplitude a sample of any channel must reach to clip
+        float clipLevel;
+        // dBFS all channels must stay below for silenceHold seconds
+        float silenceThreshold;
+        float silenceHold;
+        // dB above silenceThreshold the loudest channel must reach to end
+        // silence, so a noise floor near the threshold triggers only once
+        float hysteresis;
+    };
+
+    BlackBoxRecorder();
+    ~BlackBoxRecorder();
+
+    // returns false if the directory is not writable
+    bool open(const Settings& settings);
+    bool isOpen() const;
+
+    // allocates the ring and starts the writer, must not be called while
+    // analyzing
+    void configure(unsigned int sampleRate, unsigned char channels);
+
+    // records around the next analyzed block, from any thread
+    void requestTrigger();
+
+    // finishes a recording being written with what was captured and stops
+    // the writer, called by destructor
+    void stopWriter();
+
+    const char* getName() const override;
+    void process(
+        const float* samples,
+        std::size_t frames,
+        unsigned char channels) override;
+    // recordings are the results, nothing to publish
+    void publish() override;
+
+    // finished recordings, and of those the ones cut short
+    unsigned long getRecordings() const;
+    unsigned long getTruncatedRecordings() const;
+
+    static const char* getTriggerName(Trigger trigger);
+
+private:
+    // set by analysis while no recording is pending, then only read by the
+    // writer until it clears pending
+    struct Recording
+    {
+        Trigger trigger;
+        std::time_t time;
+        uint64_t startFrame;
+        uint64_t endFrame;
+    };
+
+    Settings settings;
+    bool opened;
+    unsigned int sampleRate;
+    unsigned char channels;
+
+    // interleaved frames, frame f is at f % capacity
+    std::unique_ptr<float[]> ring;
+    std::size_t capacity;
+    // frames ever written to the ring
+    std::atomic<uint64_t> writtenFrames;
+
+    float silenceLevel;
+    float silenceEndLevel;
+    float silentTime;
+    bool silent;
+    bool clipping;
+    std::atomic<bool> triggerRequested;
+
+    Recording recording;
+    std::atomic<bool> recordingPending;
+    std::atomic<unsigned long> recordings;
+    std::atomic<unsigned long> truncatedRecordings;
+
+    std::thread writer;
+    std::mutex writerMutex;
+    std::condition_variable writerCondition;
+    bool stopping;
+    // frames copied out of the ring, only used by the writer
+    std::unique_ptr<float[]> writeBuffer;
+    // numbers recordings in file names, since several can start within the
+    // second of their timestamp, only used by the writer
+    unsigned long sequence;
+
+    void startRecording(Trigger trigger, uint64_t frame);
+
+    void writeRecordings();
+    void writeRecording();
+    // false once stopping
+    bool waitForSamples();
+    bool writeHeader(std::FILE* file, uint64_t frames) const;
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,268 @@
+#include "EventDetector.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+float decibelsToAmplitude(float decibels)
+{
+    return std::pow(10.0f, decibels / 20.0f);
+}
+
+} // namespace
+
+MfPA::EventDetector::Thresholds::Thresholds() :
+silence(-60.0f),
+over(-3.0f),
+clip(-0.18f), // METER_UPPER_LIMIT of 0.98
+
+silenceHold(2.0f),
+overHold(0.5f),
+hysteresis(3.0f)
+{}
+
+MfPA::EventDetector::ChannelState::ChannelState() :
+silent(false),
+silentTime(0.0f),
+over(false),
+overTime(0.0f),
+clipping(false),
+belowClipTime(0.0f)
+{}
+
+MfPA::EventDetector::EventDetector() :
+file(nullptr),
+socketFD(-1),
+channels(0)
+{}
+
+MfPA::EventDetector::~EventDetector()
+{
+    if(file && file != stdout)
+    {
+        std::fclose(file);
+    }
+
+    if(socketFD >= 0)
+    {
+        close(socketFD);
+    }
+}
+
+bool MfPA::EventDetector::open(
+    const std::string& target,
+    const Thresholds& thresholds)
+{
+    this->thresholds = thresholds;
+    silenceStart = decibelsToAmplitude(thresholds.silence);
+    silenceEnd = decibelsToAmplitude(
+        thresholds.silence + thresholds.hysteresis);
+    overStart = decibelsToAmplitude(thresholds.over);
+    overEnd = decibelsToAmplitude(thresholds.over - thresholds.hysteresis);
+    clipStart = decibelsToAmplitude(thresholds.clip);
+    clipEnd = decibelsToAmplitude(thresholds.clip - thresholds.hysteresis);
+
+    if(target == "-")
+    {
+        file = stdout;
+    }
+    else if(target.compare(0, 5, "file:") == 0)
+    {
+        file = std::fopen(target.c_str() + 5, "a");
+        if(!file)
+        {
+            std::cerr << "ERROR: Failed to open events file \""
+                << target.substr(5) << "\", " << std::strerror(errno)
+                << std::endl;
+            return false;
+        }
+    }
+    else if(target.compare(0, 5, "unix:") == 0)
+    {
+        socketPath = target.substr(5);
+        if(socketPath.size() >= sizeof(sockaddr_un::sun_path))
+        {
+            std::cerr << "ERROR: Events socket path is too long" << std::endl;
+            return false;
+        }
+        socketFD = socket(
+            AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(socketFD < 0)
+        {
+            std::cerr << "ERROR: Failed to create events socket, "
+                << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        std::cerr << "ERROR: Events target must be \"-\", \"file:PATH\", or "
+            "\"unix:PATH\"" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool MfPA::EventDetector::isOpen() const
+{
+    return file || socketFD >= 0;
+}
+
+void MfPA::EventDetector::setDevice(const std::string& device)
+{
+    this->device = device;
+}
+
+void MfPA::EventDetector::setChannels(unsigned char channels)
+{
+    this->channels = channels < EVENT_DETECTOR_MAX_CHANNELS
+        ? channels : EVENT_DETECTOR_MAX_CHANNELS;
+    for(unsigned int i = 0; i < EVENT_DETECTOR_MAX_CHANNELS; ++i)
+    {
+        states[i] = ChannelState();
+    }
+}
+
+void MfPA::EventDetector::process(const float* peaks, float seconds)
+{
+    for(unsigned int i = 0; i < channels; ++i)
+    {
+        ChannelState& state = states[i];
+        float peak = peaks[i];
+
+        if(!state.silent)
+        {
+            state.silentTime = peak < silenceStart
+                ? state.silentTime + seconds : 0.0f;
+            if(state.silentTime >= thresholds.silenceHold)
+            {
+                state.silent = true;
+                emit(SILENCE_START, i, peak, state.silentTime);
+            }
+        }
+        else if(peak > silenceEnd)
+        {
+            state.silent = false;
+            state.silentTime = 0.0f;
+            emit(SILENCE_END, i, peak, 0.0f);
+        }
+
+        if(!state.over)
+        {
+            state.overTime = peak > overStart
+                ? state.overTime + seconds : 0.0f;
+            if(state.overTime >= thresholds.overHold && state.overTime > 0.0f)
+            {
+                state.over = true;
+                emit(OVER_START, i, peak, state.overTime);
+            }
+        }
+        else if(peak < overEnd)
+        {
+            state.over = false;
+            state.overTime = 0.0f;
+            emit(OVER_END, i, peak, 0.0f);
+        }
+
+        if(peak >= clipStart)
+        {
+            state.belowClipTime = 0.0f;
+            if(!state.clipping)
+            {
+                state.clipping = true;
+                emit(CLIP, i, peak, 0.0f);
+            }
+        }
+        else if(state.clipping && peak < clipEnd)
+        {
+            state.belowClipTime += seconds;
+            if(state.belowClipTime >= EVENT_DETECTOR_CLIP_REARM_TIME)
+            {
+                state.clipping = false;
+            }
+        }
+    }
+}
+
+const char* MfPA::EventDetector::getEventName(Event event)
+{
+    switch(event)
+    {
+    case SILENCE_START:
+        return "silence_start";
+    case SILENCE_END:
+        return "silence_end";
+    case OVER_START:
+        return "over_start";
+    case OVER_END:
+        return "over_end";
+    case CLIP:
+        return "clip";
+    }
+    return "unknown";
+}
+
+void MfPA::EventDetector::emit(
+    Event event,
+    unsigned int channel,
+    float peak,
+    float ago)
+{
+    // ISO 8601 UTC timestamp with milliseconds
+    auto time = std::chrono::system_clock::now()
+        - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::duration<float>(ago));
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch()).count() % 1000;
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+    char line[512];
+    int size = std::snprintf(line, sizeof(line),
+        "%s.%03ldZ %s channel=%u peak=%.1f device=%s\n",
+        timestamp,
+        milliseconds,
+        getEventName(event),
+        channel,
+        peak > 0.0f ? 20.0f * std::log10(peak) : -HUGE_VALF,
+        device.c_str());
+    if(size < 0)
+    {
+        return;
+    }
+    if((std::size_t)size >= sizeof(line))
+    {
+        size = sizeof(line) - 1;
+        line[size - 1] = '\n';
+    }
+
+    if(file)
+    {
+        std::fwrite(line, 1, size, file);
+        std::fflush(file);
+    }
+    else if(socketFD >= 0)
+    {
+        // dropped if nobody is listening, never blocks
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(sockaddr_un));
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, socketPath.c_str());
+        sendto(socketFD, line, size, MSG_DONTWAIT | MSG_NOSIGNAL,
+            (const sockaddr*) &address, sizeof(sockaddr_un));
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef EVENT_DETECTOR_HPP
+#define EVENT_DETECTOR_HPP
+
+#define EVENT_DETECTOR_MAX_CHANNELS 32
+// seconds below clip threshold before another clip event can happen
+#define EVENT_DETECTOR_CLIP_REARM_TIME 1.0f
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace MfPA
+{
+
+/*
+ * Detects silence, clipping, and levels over a threshold from the peak of
+ * each channel in a block, and writes a timestamped line for every event.
+ *
+ * Conditions must hold for a configured time before an event starts, and
+ * end only once the level moves past the threshold by the hysteresis.
+ */
+class EventDetector
+{
+public:
+    enum Event
+    {
+        SILENCE_START,
+        SILENCE_END,
+        OVER_START,
+        OVER_END,
+        CLIP
+    };
+
+    struct Thresholds
+    {
+        Thresholds();
+
+        // dBFS
+        float silence;
+        float over;
+        float clip;
+        // seconds a condition must hold before its start event
+        float silenceHold;
+        float overHold;
+        // dB a level must move back past a threshold to end a condition
+        float hysteresis;
+    };
+
+    EventDetector();
+    ~EventDetector();
+
+    // target is "-" for stdout, "file:PATH" to append to a file, or
+    // "unix:PATH" to send datagrams to a Unix socket
+    // returns false if target is invalid or could not be opened
+    bool open(const std::string& target, const Thresholds& thresholds);
+    bool isOpen() const;
+
+    // name of what is metered, included in events
+    void setDevice(const std::string& device);
+    // resets state of all channels
+    void setChannels(unsigned char channels);
+
+    // peaks are linear amplitude of each channel over "seconds" of audio
+    void process(const float* peaks, float seconds);
+
+    static const char* getEventName(Event event);
+
+private:
+    struct ChannelState
+    {
+        ChannelState();
+
+        bool silent;
+        float silentTime;
+        bool over;
+        float overTime;
+        bool clipping;
+        float belowClipTime;
+    };
+
+    Thresholds thresholds;
+    // linear amplitude versions of thresholds
+    float silenceStart;
+    float silenceEnd;
+    float overStart;
+    float overEnd;
+    float clipStart;
+    float clipEnd;
+
+    std::FILE* file;
+    int socketFD;
+    std::string socketPath;
+    std::string device;
+    unsigned char channels;
+    ChannelState states[EVENT_DETECTOR_MAX_CHANNELS];
+
+    // "ago" is how many seconds ago the event happened
+    void emit(Event event, unsigned int channel, float peak, float ago);
+
+};
+
+} // namespace MfPA
+
+#endif
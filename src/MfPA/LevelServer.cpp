@@ -0,0 +1,469 @@
+#include "LevelServer.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "AllocationAudit.hpp"
+
+namespace
+{
+
+std::size_t getRecordSize(const char* record)
+{
+    std::uint16_t channels;
+    std::uint16_t flags;
+    std::memcpy(&channels, record + 16, sizeof(std::uint16_t));
+    std::memcpy(&flags, record + 18, sizeof(std::uint16_t));
+    return LEVEL_SERVER_RECORD_HEADER_SIZE
+        + (std::size_t)channels
+            * (flags & LEVEL_SERVER_FLAG_STATISTICS ? 4 : 2) * sizeof(float);
+}
+
+} // namespace
+
+MfPA::LevelServer::Client::Client(int fd) :
+fd(fd),
+decimation(1),
+counter(0),
+stalledPublishes(0),
+wantsStatistics(false),
+sent(0),
+replySent(0),
+requestSize(0)
+{}
+
+MfPA::LevelServer::LevelServer() :
+listenFD(-1),
+sequence(0),
+statisticsRequested(false)
+{}
+
+MfPA::LevelServer::~LevelServer()
+{
+    for(auto& client : clients)
+    {
+        close(client.fd);
+    }
+
+    if(listenFD >= 0)
+    {
+        close(listenFD);
+        unlink(socketPath.c_str());
+    }
+}
+
+bool MfPA::LevelServer::listen(const char* path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(sockaddr_un));
+    address.sun_family = AF_UNIX;
+    if(std::strlen(path) >= sizeof(address.sun_path))
+    {
+        std::cerr << "ERROR: Level server socket path is too long" << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path);
+
+    // remove stale socket left by a previous instance
+    struct stat pathStat;
+    if(stat(path, &pathStat) == 0 && S_ISSOCK(pathStat.st_mode))
+    {
+        unlink(path);
+    }
+
+    listenFD = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFD < 0)
+    {
+        std::cerr << "ERROR: Failed to create level server socket, "
+            << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    if(bind(listenFD, (const sockaddr*) &address, sizeof(sockaddr_un)) != 0
+        || ::listen(listenFD, 8) != 0)
+    {
+        std::cerr << "ERROR: Failed to listen on \"" << path << "\", "
+            << std::strerror(errno) << std::endl;
+        close(listenFD);
+        listenFD = -1;
+        return false;
+    }
+
+    socketPath = path;
+    clients.reserve(LEVEL_SERVER_MAX_CLIENTS);
+    return true;
+}
+
+bool MfPA::LevelServer::isListening() const
+{
+    return listenFD >= 0;
+}
+
+void MfPA::LevelServer::poll()
+{
+    if(listenFD < 0)
+    {
+        return;
+    }
+
+    acceptClients();
+
+    for(std::size_t i = clients.size(); i-- > 0; )
+    {
+        if(!readRequests(clients[i]))
+        {
+            dropClient(i);
+        }
+    }
+}
+
+void MfPA::LevelServer::publish(const float* values, unsigned char channels)
+{
+    if(listenFD < 0 || clients.empty())
+    {
+        return;
+    }
+
+    writeRecord(record, 0, values, channels, 2);
+    ++sequence;
+
+    for(std::size_t i = clients.size(); i-- > 0; )
+    {
+        queueRecord(clients[i]);
+        if(!flush(clients[i]))
+        {
+            dropClient(i);
+        }
+    }
+}
+
+bool MfPA::LevelServer::takeStatisticsRequest()
+{
+    bool requested = statisticsRequested;
+    statisticsRequested = false;
+    return requested;
+}
+
+void MfPA::LevelServer::publishStatistics(
+    const float* values,
+    unsigned char channels)
+{
+    writeRecord(
+        statisticsRecord,
+        LEVEL_SERVER_FLAG_STATISTICS,
+        values,
+        channels,
+        4);
+
+    for(std::size_t i = clients.size(); i-- > 0; )
+    {
+        Client& client = clients[i];
+        if(!client.wantsStatistics)
+        {
+            continue;
+        }
+        if(client.replySent > 0)
+        {
+            // still sending the previous answer, answered by the next
+            // statistics instead
+            statisticsRequested = true;
+            continue;
+        }
+        client.wantsStatistics = false;
+
+        if(client.reply.capacity() < statisticsRecord.size())
+        {
+#ifdef MFPA_ALLOCATION_AUDIT
+            // once per subscriber, not steady state
+            AllocationAudit::Scope auditScope(AllocationAudit::OTHER);
+#endif
+            client.reply.reserve(statisticsRecord.size());
+        }
+        // not decimated or coalesced, it's an answer to a request
+        client.reply.assign(statisticsRecord.begin(), statisticsRecord.end());
+        if(!flush(client))
+        {
+            dropClient(i);
+        }
+    }
+}
+
+void MfPA::LevelServer::writeRecord(
+    std::vector<char>& record,
+    std::uint16_t flags,
+    const float* values,
+    unsigned char channels,
+    unsigned int valuesPerChannel)
+{
+    std::uint32_t magic = LEVEL_SERVER_RECORD_MAGIC;
+    std::uint64_t timestamp = std::chrono::duration_cast<
+        std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::uint16_t channels16 = channels;
+    std::uint32_t reserved = 0;
+
+    record.resize(LEVEL_SERVER_RECORD_HEADER_SIZE
+        + (std::size_t)channels * valuesPerChannel * sizeof(float));
+    std::memcpy(&record[0], &magic, 4);
+    std::memcpy(&record[4], &sequence, 4);
+    std::memcpy(&record[8], &timestamp, 8);
+    std::memcpy(&record[16], &channels16, 2);
+    std::memcpy(&record[18], &flags, 2);
+    std::memcpy(&record[20], &reserved, 4);
+    std::memcpy(
+        &record[LEVEL_SERVER_RECORD_HEADER_SIZE],
+        values,
+        (std::size_t)channels * valuesPerChannel * sizeof(float));
+}
+
+void MfPA::LevelServer::acceptClients()
+{
+    while(true)
+    {
+        int fd = accept4(listenFD, nullptr, nullptr,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                std::cerr << "WARNING: Failed to accept level server "
+                    "subscriber, " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        if(clients.size() >= LEVEL_SERVER_MAX_CLIENTS)
+        {
+#ifndef NDEBUG
+            std::cout << "Level server full, rejecting subscriber"
+                << std::endl;
+#endif
+            close(fd);
+            continue;
+        }
+        clients.emplace_back(fd);
+#ifndef NDEBUG
+        std::cout << "Level server got subscriber (" << clients.size()
+            << " total)" << std::endl;
+#endif
+    }
+}
+
+bool MfPA::LevelServer::readRequests(Client& client)
+{
+    while(true)
+    {
+        ssize_t n = recv(
+            client.fd,
+            client.request + client.requestSize,
+            sizeof(client.request) - 1 - client.requestSize,
+            MSG_DONTWAIT);
+        if(n == 0)
+        {
+            // subscriber disconnected
+            return false;
+        }
+        else if(n < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        client.requestSize += n;
+
+        std::size_t lineStart = 0;
+        for(std::size_t i = 0; i < client.requestSize; ++i)
+        {
+            if(client.request[i] == '\n')
+            {
+                client.request[i] = '\0';
+                handleRequest(client, client.request + lineStart);
+                lineStart = i + 1;
+            }
+        }
+        if(lineStart > 0)
+        {
+            client.requestSize -= lineStart;
+            std::memmove(
+                client.request,
+                client.request + lineStart,
+                client.requestSize);
+        }
+        else if(client.requestSize == sizeof(client.request) - 1)
+        {
+            // discard overlong request
+            client.requestSize = 0;
+        }
+    }
+}
+
+void MfPA::LevelServer::handleRequest(Client& client, const char* request)
+{
+    if(std::strncmp(request, "decimate ", 9) == 0)
+    {
+        unsigned long decimation = std::strtoul(request + 9, nullptr, 10);
+        if(decimation > 0)
+        {
+            client.decimation = decimation;
+            client.counter = 0;
+        }
+    }
+    else if(std::strcmp(request, "statistics") == 0)
+    {
+        client.wantsStatistics = true;
+        statisticsRequested = true;
+    }
+#ifndef NDEBUG
+    else
+    {
+        std::cout << "Level server got unknown request \"" << request << "\""
+            << std::endl;
+    }
+#endif
+}
+
+void MfPA::LevelServer::queueRecord(Client& client)
+{
+    if(++client.counter < client.decimation)
+    {
+        return;
+    }
+    client.counter = 0;
+
+    // full capacity up front, so a client falling behind doesn't allocate
+    if(client.pending.capacity()
+        < LEVEL_SERVER_MAX_PENDING_RECORDS * record.size())
+    {
+#ifdef MFPA_ALLOCATION_AUDIT
+        // once per subscriber, not steady state
+        AllocationAudit::Scope auditScope(AllocationAudit::OTHER);
+#endif
+        client.pending.reserve(
+            LEVEL_SERVER_MAX_PENDING_RECORDS * record.size());
+    }
+
+    if(client.pending.size() + record.size()
+        > LEVEL_SERVER_MAX_PENDING_RECORDS * record.size())
+    {
+        // coalesce, keep only a partially sent record so framing is kept
+        if(client.sent > 0)
+        {
+            client.pending.resize(getRecordSize(client.pending.data()));
+        }
+        else
+        {
+            client.pending.clear();
+        }
+    }
+
+    client.pending.insert(client.pending.end(), record.begin(), record.end());
+}
+
+bool MfPA::LevelServer::flush(Client& client)
+{
+    while(true)
+    {
+        // the reply goes out between records, so while one is waiting only
+        // the rest of a partially sent record is sent before it
+        bool sendingReply = !client.reply.empty() && client.sent == 0;
+        const char* data;
+        std::size_t size;
+        if(sendingReply)
+        {
+            data = client.reply.data() + client.replySent;
+            size = client.reply.size() - client.replySent;
+        }
+        else if(!client.pending.empty())
+        {
+            data = client.pending.data() + client.sent;
+            size = (client.reply.empty()
+                ? client.pending.size()
+                : getRecordSize(client.pending.data())) - client.sent;
+        }
+        else
+        {
+            client.stalledPublishes = 0;
+            return true;
+        }
+
+        ssize_t n = send(
+            client.fd,
+            data,
+            size,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                return false;
+            }
+            n = 0;
+        }
+
+        if(n == 0)
+        {
+            if(++client.stalledPublishes > LEVEL_SERVER_MAX_STALLED_PUBLISHES)
+            {
+#ifndef NDEBUG
+                std::cout << "Level server dropping stalled subscriber"
+                    << std::endl;
+#endif
+                return false;
+            }
+            return true;
+        }
+        client.stalledPublishes = 0;
+
+        if(sendingReply)
+        {
+            client.replySent += n;
+            if(client.replySent == client.reply.size())
+            {
+                client.reply.clear();
+                client.replySent = 0;
+            }
+        }
+        else
+        {
+            client.sent += n;
+
+            // discard fully sent records
+            std::size_t sentRecords = 0;
+            while(sentRecords < client.pending.size())
+            {
+                std::size_t recordSize =
+                    getRecordSize(client.pending.data() + sentRecords);
+                if(sentRecords + recordSize > client.sent)
+                {
+                    break;
+                }
+                sentRecords += recordSize;
+            }
+            client.pending.erase(
+                client.pending.begin(),
+                client.pending.begin() + sentRecords);
+            client.sent -= sentRecords;
+        }
+
+        if((std::size_t)n < size)
+        {
+            // socket is full
+            return true;
+        }
+    }
+}
+
+void MfPA::LevelServer::dropClient(std::size_t index)
+{
+    close(clients[index].fd);
+    clients.erase(clients.begin() + index);
+#ifndef NDEBUG
+    std::cout << "Level server lost subscriber (" << clients.size()
+        << " remaining)" << std::endl;
+#endif
+}
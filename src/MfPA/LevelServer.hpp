@@ -0,0 +1,114 @@
+#ifndef LEVEL_SERVER_HPP
+#define LEVEL_SERVER_HPP
+
+// max amount of connected subscribers
+#define LEVEL_SERVER_MAX_CLIENTS 32
+// max amount of records queued for a slow subscriber before coalescing
+#define LEVEL_SERVER_MAX_PENDING_RECORDS 32
+// amount of consecutive publishes without progress before dropping subscriber
+#define LEVEL_SERVER_MAX_STALLED_PUBLISHES 240
+#define LEVEL_SERVER_RECORD_MAGIC 0x4C50664D // "MfPL" in little endian
+#define LEVEL_SERVER_RECORD_HEADER_SIZE 24
+// record holds level statistics instead of levels
+#define LEVEL_SERVER_FLAG_STATISTICS 0x0001
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MfPA
+{
+
+/*
+ * Listens on a Unix domain socket and pushes level records to subscribers.
+ *
+ * Each record is a 24 byte header followed by two floats per channel:
+ *   uint32 magic (LEVEL_SERVER_RECORD_MAGIC)
+ *   uint32 sequence (incremented every publish)
+ *   uint64 timestamp in microseconds (monotonic clock)
+ *   uint16 channel count
+ *   uint16 flags (LEVEL_SERVER_FLAG_*)
+ *   uint32 reserved
+ *   float main, float prev (repeated for each channel)
+ * All values are in host byte order.
+ *
+ * A subscriber may send "decimate N\n" to only receive every Nth record.
+ * A subscriber may send "statistics\n" to receive one record with
+ * LEVEL_SERVER_FLAG_STATISTICS set, whose values are instead
+ * float p50, p95, p99, max in dBFS (repeated for each channel), once
+ * statistics are available.
+ * Subscribers that cannot keep up have their queued records coalesced into
+ * the newest one, and are dropped if they stop reading entirely. A
+ * statistics record is queued separately and sent between level records,
+ * so coalescing never drops it.
+ */
+class LevelServer
+{
+public:
+    LevelServer();
+    ~LevelServer();
+
+    // returns false on failure
+    bool listen(const char* path);
+    bool isListening() const;
+
+    // accepts new subscribers and handles their requests, never blocks
+    void poll();
+    // values holds "main" and "prev" for each channel, in that order
+    void publish(const float* values, unsigned char channels);
+    // returns true once for every poll in which statistics were requested
+    bool takeStatisticsRequest();
+    // values holds p50, p95, p99, and max for each channel, in that order,
+    // sent to subscribers that requested statistics
+    void publishStatistics(const float* values, unsigned char channels);
+
+private:
+    struct Client
+    {
+        Client(int fd);
+
+        int fd;
+        unsigned int decimation;
+        unsigned int counter;
+        unsigned int stalledPublishes;
+        bool wantsStatistics;
+        // pending output, first record may be partially sent
+        std::vector<char> pending;
+        std::size_t sent;
+        // statistics record answering a request, sent once no record of
+        // pending is partially sent
+        std::vector<char> reply;
+        std::size_t replySent;
+        // partial request line
+        char request[64];
+        std::size_t requestSize;
+    };
+
+    int listenFD;
+    std::string socketPath;
+    std::uint32_t sequence;
+    std::vector<char> record;
+    std::vector<Client> clients;
+    bool statisticsRequested;
+    std::vector<char> statisticsRecord;
+
+    void writeRecord(
+        std::vector<char>& record,
+        std::uint16_t flags,
+        const float* values,
+        unsigned char channels,
+        unsigned int valuesPerChannel);
+    void acceptClients();
+    // returns false if client should be dropped
+    bool readRequests(Client& client);
+    void handleRequest(Client& client, const char* request);
+    void queueRecord(Client& client);
+    // returns false if client should be dropped
+    bool flush(Client& client);
+    void dropClient(std::size_t index);
+
+};
+
+} // namespace MfPA
+
+#endif
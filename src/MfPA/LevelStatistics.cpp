@@ -0,0 +1,285 @@
+#include "LevelStatistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+
+MfPA::LevelStatistics::LevelStatistics() :
+channels(0),
+slotSeconds(1.0f),
+currentSlot(0),
+filledSlots(1),
+slotElapsed(0.0f),
+intervalElapsed(0.0f),
+snapshotRequested(false),
+snapshotTaken(false),
+snapshotCoveredSeconds(0.0f)
+{
+    for(unsigned int i = 0; i < LEVEL_STATISTICS_MAX_CHANNELS; ++i)
+    {
+        intervalPeaks[i] = 0.0f;
+    }
+}
+
+bool MfPA::LevelStatistics::parseWindow(
+    const std::string& text,
+    float& seconds)
+{
+    float value;
+    std::size_t end;
+    try {
+        value = std::stof(text, &end);
+    } catch (const std::logic_error& e) {
+        return false;
+    }
+
+    std::string unit = text.substr(end);
+    if(unit.empty() || unit == "s")
+    {
+        seconds = value;
+    }
+    else if(unit == "m")
+    {
+        seconds = value * 60.0f;
+    }
+    else if(unit == "h")
+    {
+        seconds = value * 3600.0f;
+    }
+    else if(unit == "d")
+    {
+        seconds = value * 86400.0f;
+    }
+    else
+    {
+        return false;
+    }
+    // also rejects infinity and NaN
+    return seconds > 0.0f && seconds <= LEVEL_STATISTICS_MAX_WINDOW;
+}
+
+void MfPA::LevelStatistics::configure(
+    unsigned char channels,
+    float windowSeconds)
+{
+    this->channels = channels < LEVEL_STATISTICS_MAX_CHANNELS
+        ? channels : LEVEL_STATISTICS_MAX_CHANNELS;
+    slotSeconds = std::max(
+        windowSeconds / LEVEL_STATISTICS_SLOTS,
+        LEVEL_STATISTICS_INTERVAL);
+
+    unsigned int bins = getBinCount();
+    binEdges.resize(bins - 1);
+    for(unsigned int i = 0; i < bins - 1; ++i)
+    {
+        binEdges[i] = std::pow(10.0f,
+            (LEVEL_STATISTICS_MIN_DB + i * LEVEL_STATISTICS_BIN_WIDTH) / 20.0f);
+    }
+    slotCounts.assign(
+        (std::size_t)this->channels * LEVEL_STATISTICS_SLOTS * bins, 0);
+    totalCounts.assign((std::size_t)this->channels * bins, 0);
+    slotMax.assign((std::size_t)this->channels * LEVEL_STATISTICS_SLOTS, 0.0f);
+
+    currentSlot = 0;
+    filledSlots = 1;
+    slotElapsed = 0.0f;
+    intervalElapsed = 0.0f;
+    for(unsigned int i = 0; i < LEVEL_STATISTICS_MAX_CHANNELS; ++i)
+    {
+        intervalPeaks[i] = 0.0f;
+    }
+}
+
+bool MfPA::LevelStatistics::isConfigured() const
+{
+    return channels > 0;
+}
+
+unsigned char MfPA::LevelStatistics::getChannels() const
+{
+    return channels;
+}
+
+void MfPA::LevelStatistics::process(const float* peaks, float seconds)
+{
+    if(channels == 0)
+    {
+        return;
+    }
+
+    for(unsigned int i = 0; i < channels; ++i)
+    {
+        intervalPeaks[i] = std::max(intervalPeaks[i], peaks[i]);
+    }
+    intervalElapsed += seconds;
+    if(intervalElapsed >= LEVEL_STATISTICS_INTERVAL)
+    {
+        countInterval();
+    }
+
+    if(snapshotRequested.load(std::memory_order_relaxed)
+        && snapshotRequested.exchange(false))
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        getPercentiles(snapshot, snapshotCoveredSeconds);
+        snapshotTaken = true;
+    }
+}
+
+void MfPA::LevelStatistics::requestSnapshot()
+{
+    snapshotRequested = true;
+}
+
+bool MfPA::LevelStatistics::takeSnapshot(
+    Percentiles* percentiles,
+    float& coveredSeconds)
+{
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    if(!snapshotTaken)
+    {
+        return false;
+    }
+    std::copy(snapshot, snapshot + channels, percentiles);
+    coveredSeconds = snapshotCoveredSeconds;
+    snapshotTaken = false;
+    return true;
+}
+
+void MfPA::LevelStatistics::getPercentiles(
+    Percentiles* percentiles,
+    float& coveredSeconds) const
+{
+    unsigned int bins = getBinCount();
+    auto binLevel = [] (unsigned int bin) {
+        return bin == 0 ? -HUGE_VALF
+            : LEVEL_STATISTICS_MIN_DB
+                + ((float)bin - 0.5f) * LEVEL_STATISTICS_BIN_WIDTH;
+    };
+
+    for(unsigned int channel = 0; channel < channels; ++channel)
+    {
+        const uint32_t* counts = &totalCounts[(std::size_t)channel * bins];
+        uint64_t total = 0;
+        for(unsigned int bin = 0; bin < bins; ++bin)
+        {
+            total += counts[bin];
+        }
+
+        // smallest bin reaching each percentile's share of the counts
+        const float shares[3] = {0.5f, 0.95f, 0.99f};
+        float levels[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+        uint64_t cumulative = 0;
+        unsigned int next = 0;
+        for(unsigned int bin = 0; bin < bins && next < 3 && total > 0; ++bin)
+        {
+            cumulative += counts[bin];
+            while(next < 3
+                && (float)cumulative >= std::ceil(shares[next] * total))
+            {
+                levels[next++] = binLevel(bin);
+            }
+        }
+
+        float max = 0.0f;
+        for(unsigned int slot = 0; slot < LEVEL_STATISTICS_SLOTS; ++slot)
+        {
+            max = std::max(max,
+                slotMax[(std::size_t)channel * LEVEL_STATISTICS_SLOTS + slot]);
+        }
+
+        // bin centers may be above the exact max
+        float maxLevel = max > 0.0f ? 20.0f * std::log10(max) : -HUGE_VALF;
+        percentiles[channel].p50 = std::min(levels[0], maxLevel);
+        percentiles[channel].p95 = std::min(levels[1], maxLevel);
+        percentiles[channel].p99 = std::min(levels[2], maxLevel);
+        percentiles[channel].max = maxLevel;
+    }
+
+    coveredSeconds = (filledSlots - 1) * slotSeconds + slotElapsed;
+}
+
+void MfPA::LevelStatistics::print(
+    std::ostream& stream,
+    const Percentiles* percentiles,
+    unsigned char channels,
+    float coveredSeconds)
+{
+    stream << "Level statistics over " << coveredSeconds << " s (dBFS):"
+        << std::endl;
+    for(unsigned int i = 0; i < channels; ++i)
+    {
+        stream << "[" << i << "] p50 " << percentiles[i].p50
+            << " p95 " << percentiles[i].p95
+            << " p99 " << percentiles[i].p99
+            << " max " << percentiles[i].max << std::endl;
+    }
+}
+
+unsigned int MfPA::LevelStatistics::getBinCount() const
+{
+    // first bin is everything below LEVEL_STATISTICS_MIN_DB
+    return 1 + (unsigned int)std::ceil(
+        (LEVEL_STATISTICS_MAX_DB - LEVEL_STATISTICS_MIN_DB)
+        / LEVEL_STATISTICS_BIN_WIDTH);
+}
+
+unsigned int MfPA::LevelStatistics::findBin(float amplitude) const
+{
+    // levels above LEVEL_STATISTICS_MAX_DB end up in the last bin
+    return std::upper_bound(binEdges.begin(), binEdges.end(), amplitude)
+        - binEdges.begin();
+}
+
+void MfPA::LevelStatistics::countInterval()
+{
+    // a block longer than an interval counts as several intervals
+    unsigned int intervals = intervalElapsed / LEVEL_STATISTICS_INTERVAL;
+    intervalElapsed -= intervals * LEVEL_STATISTICS_INTERVAL;
+
+    slotElapsed += intervals * LEVEL_STATISTICS_INTERVAL;
+    while(slotElapsed >= slotSeconds)
+    {
+        slotElapsed -= slotSeconds;
+        advanceSlot();
+    }
+
+    unsigned int bins = getBinCount();
+    for(unsigned int channel = 0; channel < channels; ++channel)
+    {
+        unsigned int bin = findBin(intervalPeaks[channel]);
+        slotCounts[((std::size_t)channel * LEVEL_STATISTICS_SLOTS
+            + currentSlot) * bins + bin] += intervals;
+        totalCounts[(std::size_t)channel * bins + bin] += intervals;
+        float& max = slotMax[
+            (std::size_t)channel * LEVEL_STATISTICS_SLOTS + currentSlot];
+        max = std::max(max, intervalPeaks[channel]);
+        intervalPeaks[channel] = 0.0f;
+    }
+}
+
+void MfPA::LevelStatistics::advanceSlot()
+{
+    // the next slot is the oldest, its counts leave the window
+    currentSlot = (currentSlot + 1) % LEVEL_STATISTICS_SLOTS;
+    if(filledSlots < LEVEL_STATISTICS_SLOTS)
+    {
+        ++filledSlots;
+    }
+
+    unsigned int bins = getBinCount();
+    for(unsigned int channel = 0; channel < channels; ++channel)
+    {
+        uint32_t* counts = &slotCounts[((std::size_t)channel
+            * LEVEL_STATISTICS_SLOTS + currentSlot) * bins];
+        uint32_t* totals = &totalCounts[(std::size_t)channel * bins];
+        for(unsigned int bin = 0; bin < bins; ++bin)
+        {
+            totals[bin] -= counts[bin];
+            counts[bin] = 0;
+        }
+        slotMax[(std::size_t)channel * LEVEL_STATISTICS_SLOTS + currentSlot]
+            = 0.0f;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef LEVEL_STATISTICS_HPP
+#define LEVEL_STATISTICS_HPP
+
+#define LEVEL_STATISTICS_MAX_CHANNELS 32
+// seconds of audio whose peak is one value of the distribution
+#define LEVEL_STATISTICS_INTERVAL 0.1f
+// histogram range and resolution, lower levels are counted in the first bin
+#define LEVEL_STATISTICS_MIN_DB -100.0f
+#define LEVEL_STATISTICS_MAX_DB 6.0f
+#define LEVEL_STATISTICS_BIN_WIDTH 0.25f
+// the window is split into this many slots, which expire one at a time
+#define LEVEL_STATISTICS_SLOTS 60
+// longest window in seconds (a year), well below where counts of an interval
+// per bin could overflow
+#define LEVEL_STATISTICS_MAX_WINDOW 31536000.0f
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MfPA
+{
+
+/*
+ * Distribution of each channel's level over a long sliding window, such as
+ * minutes to days, in fixed memory.
+ *
+ * Every LEVEL_STATISTICS_INTERVAL the peak of each channel is counted in a
+ * histogram of LEVEL_STATISTICS_BIN_WIDTH dB bins. The window is a ring of
+ * LEVEL_STATISTICS_SLOTS histograms plus their running sum, so percentiles
+ * are read from the sum and are accurate to a bin, and the oldest slot is
+ * subtracted as the window slides.
+ */
+class LevelStatistics
+{
+public:
+    // dBFS, -HUGE_VALF if below LEVEL_STATISTICS_MIN_DB
+    struct Percentiles
+    {
+        float p50;
+        float p95;
+        float p99;
+        float max;
+    };
+
+    LevelStatistics();
+
+    // parses a number of seconds with an optional unit of "s", "m", "h", or
+    // "d", returns false if invalid or not in (0, LEVEL_STATISTICS_MAX_WINDOW]
+    static bool parseWindow(const std::string& text, float& seconds);
+
+    // clears all counts
+    void configure(unsigned char channels, float windowSeconds);
+    bool isConfigured() const;
+    unsigned char getChannels() const;
+
+    // peaks are linear amplitude of each channel over "seconds" of audio
+    void process(const float* peaks, float seconds);
+
+    // from any thread or a signal handler, the next process call takes a
+    // snapshot
+    void requestSnapshot();
+    // copies the newest snapshot if one was taken since the last call,
+    // "percentiles" holds one entry per channel
+    bool takeSnapshot(Percentiles* percentiles, float& coveredSeconds);
+    // percentiles right now, only from the thread calling process
+    void getPercentiles(Percentiles* percentiles, float& coveredSeconds) const;
+
+    static void print(
+        std::ostream& stream,
+        const Percentiles* percentiles,
+        unsigned char channels,
+        float coveredSeconds);
+
+private:
+    unsigned char channels;
+    float slotSeconds;
+
+    // amplitude at the lower edge of each bin after the first, for lookup
+    std::vector<float> binEdges;
+    // channel major, LEVEL_STATISTICS_SLOTS histograms per channel
+    std::vector<uint32_t> slotCounts;
+    std::vector<uint32_t> totalCounts;
+    std::vector<float> slotMax;
+
+    unsigned int currentSlot;
+    unsigned int filledSlots;
+    float slotElapsed;
+    float intervalElapsed;
+    float intervalPeaks[LEVEL_STATISTICS_MAX_CHANNELS];
+
+    std::atomic<bool> snapshotRequested;
+    std::mutex snapshotMutex;
+    bool snapshotTaken;
+    Percentiles snapshot[LEVEL_STATISTICS_MAX_CHANNELS];
+    float snapshotCoveredSeconds;
+
+    unsigned int getBinCount() const;
+    unsigned int findBin(float amplitude) const;
+    void countInterval();
+    void advanceSlot();
+
+};
+
+} // namespace MfPA
+
+#endif
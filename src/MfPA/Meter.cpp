@@ -1,18 +1,60 @@
 #include "Meter.hpp"
 
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <cmath>
+#include <csignal>
+#include <thread>
 
 #include <GDT/GameLoop.hpp>
 
+#include "AllocationAudit.hpp"
+
+namespace
+{
+
+// set by SIGINT/SIGTERM when not drawing to a window
+volatile std::sig_atomic_t interrupted = 0;
+
+void interruptHandler(int /* signal */)
+{
+    interrupted = 1;
+}
+
+// set by SIGUSR1 when level statistics are enabled
+volatile std::sig_atomic_t statisticsSignalled = 0;
+
+void statisticsHandler(int /* signal */)
+{
+    statisticsSignalled = 1;
+}
+
+// set by SIGUSR2 when the black box is enabled
+volatile std::sig_atomic_t blackBoxSignalled = 0;
+
+void blackBoxHandler(int /* signal */)
+{
+    blackBoxSignalled = 1;
+}
+
+// lower one eighth block to full block, index is eighths filled
+const uint16_t BLOCK_GLYPHS[9] = {
+    ' ', 0x2581, 0x2582, 0x2583, 0x2584, 0x2585, 0x2586, 0x2587, 0x2588
+};
+const uint16_t HOLD_GLYPH = 0x2594; // upper one eighth block
+const uint16_t MARKING_GLYPH = 0x2500; // horizontal line
+
+} // namespace
+
 MfPA::Meter::Meter(
     const char* sinkOrSourceName,
     bool isSink,
     unsigned int framerateLimit,
     sf::Color barColor,
-    bool hideMarkings
+    bool hideMarkings,
+    Renderer renderer
 ) :
 currentState(WAITING),
 isMonitoringSink(isSink),
@@ -23,16 +65,38 @@ gotSourceInfo(false),
 mainLoop(nullptr),
 context(nullptr),
 stream(nullptr),
+sampleBlocksHead(0),
+sampleBlocksCount(0),
+hadCaptureGap(false),
+overrunCheckStarted(false),
+overrunCheckLatency(0),
+overrunCheckFrames(0),
 runFlag(true),
 channels(1),
 channelsChanged(true),
-window(sf::VideoMode(100,400), "Meter for PulseAudio"),
+sampleRate(1),
+renderer(renderer),
 barColor(barColor),
 inverted(~barColor.r, ~barColor.g, ~barColor.b),
 varray(sf::PrimitiveType::Lines, 2),
-hideMarkings(hideMarkings)
+hideMarkings(hideMarkings),
+ballisticsMode(Ballistics::LINEAR),
+showVectorscope(false),
+vectorscopePair(0),
+meterApplications(false),
+lowLatencyPacing(false),
+consumedSamples(false),
+statisticsWindow(0.0f),
+printStatisticsSnapshot(false),
+useAnalysisPipeline(false),
+analysisThreads(0),
+printStageTimings(false)
 {
-    window.setView(sf::View(sf::FloatRect(0.0f, 0.0f, 1.0f, 1.0f)));
+    peakAnalyzer.setBlockCallback(
+        [this] (const float* peaks, std::size_t frames) {
+            finishBlock(peaks, frames);
+        });
+
     bar.setFillColor(barColor);
     if((int)inverted.r + (int)inverted.g + (int)inverted.b < 75)
     {
@@ -51,6 +115,33 @@ hideMarkings(hideMarkings)
     }
     varray[1].color = varray[0].color;
 
+    if(renderer == WINDOW)
+    {
+        window.reset(new sf::RenderWindow(
+            sf::VideoMode(100,400), "Meter for PulseAudio"));
+        window->setView(sf::View(sf::FloatRect(0.0f, 0.0f, 1.0f, 1.0f)));
+    }
+    else if(renderer == TERMINAL)
+    {
+        terminal.setColor(TerminalRenderer::BAR,
+            barColor.r, barColor.g, barColor.b);
+        terminal.setColor(TerminalRenderer::PEAK,
+            inverted.r, inverted.g, inverted.b);
+        terminal.setColor(TerminalRenderer::MARKING,
+            varray[0].color.r, varray[0].color.g, varray[0].color.b);
+        if(!terminal.open())
+        {
+            currentState = FAILED;
+        }
+    }
+
+    if(renderer != WINDOW)
+    {
+        // let the terminal be restored and pending output be written
+        std::signal(SIGINT, interruptHandler);
+        std::signal(SIGTERM, interruptHandler);
+    }
+
     setenv("PULSE_PROP_application.name", "Meter for PulseAudio", 1);
     setenv("PULSE_PROP_application.icon_name", "multimedia-volume-control", 1);
 
@@ -70,6 +161,9 @@ hideMarkings(hideMarkings)
 
 MfPA::Meter::~Meter()
 {
+    pipeline.stop();
+    applicationStreams.clear();
+
     if(stream)
     {
         pa_stream_disconnect(stream);
@@ -115,7 +209,7 @@ void MfPA::Meter::get_context_callback(pa_context* c, void* userdata)
             break;
         }
         meter->currentState = MfPA::Meter::PROCESSING;
-        if(meter->sinkOrSourceName[0] == '\0')
+        if(meter->sinkOrSourceName.empty())
         {
 #ifndef NDEBUG
             std::cout << "Attempting to get default" << std::endl;
@@ -134,7 +228,7 @@ void MfPA::Meter::get_context_callback(pa_context* c, void* userdata)
             // sink provided, getting info on sink
             pa_operation_unref(pa_context_get_sink_info_by_name(
                 c,
-                meter->sinkOrSourceName,
+                meter->sinkOrSourceName.c_str(),
                 MfPA::Meter::get_sink_info_callback,
                 userdata));
         }
@@ -146,10 +240,29 @@ void MfPA::Meter::get_context_callback(pa_context* c, void* userdata)
             // source provided, getting info on source
             pa_operation_unref(pa_context_get_source_info_by_name(
                 c,
-                meter->sinkOrSourceName,
+                meter->sinkOrSourceName.c_str(),
                 MfPA::Meter::get_source_info_callback,
                 userdata));
         }
+        if(meter->meterApplications)
+        {
+#ifndef NDEBUG
+            std::cout << "Subscribing to application streams" << std::endl;
+#endif
+            pa_context_set_subscribe_callback(
+                c,
+                MfPA::Meter::get_subscribe_callback,
+                userdata);
+            pa_operation_unref(pa_context_subscribe(
+                c,
+                PA_SUBSCRIPTION_MASK_SINK_INPUT,
+                nullptr,
+                nullptr));
+            pa_operation_unref(pa_context_get_sink_input_info_list(
+                c,
+                MfPA::Meter::get_sink_input_info_callback,
+                userdata));
+        }
         break;
     case PA_CONTEXT_FAILED:
         meter->currentState = MfPA::Meter::FAILED;
@@ -176,21 +289,23 @@ void MfPA::Meter::get_defaults_callback(
     MfPA::Meter* meter = (MfPA::Meter*) userdata;
     if(meter->isMonitoringSink)
     {
-        meter->sinkOrSourceName = i->default_sink_name;
+        meter->sinkOrSourceName =
+            i->default_sink_name ? i->default_sink_name : "";
         // get sink info
         pa_operation_unref(pa_context_get_sink_info_by_name(
             c,
-            meter->sinkOrSourceName,
+            meter->sinkOrSourceName.c_str(),
             MfPA::Meter::get_sink_info_callback,
             userdata));
     }
     else
     {
-        meter->sinkOrSourceName = i->default_source_name;
+        meter->sinkOrSourceName =
+            i->default_source_name ? i->default_source_name : "";
         // get source info
         pa_operation_unref(pa_context_get_source_info_by_name(
             c,
-            meter->sinkOrSourceName,
+            meter->sinkOrSourceName.c_str(),
             MfPA::Meter::get_source_info_callback,
             userdata));
     }
@@ -264,6 +379,54 @@ void MfPA::Meter::get_source_info_callback(
 
     meter->channels = i->sample_spec.channels;
     meter->channelsChanged = true;
+    meter->sampleRate = i->sample_spec.rate;
+    meter->peakAnalyzer.getBallistics().configure(
+        i->sample_spec.rate,
+        i->sample_spec.channels);
+    meter->events.setDevice(i->name);
+    meter->events.setChannels(i->sample_spec.channels);
+    if(meter->statisticsWindow > 0.0f)
+    {
+        meter->statistics.configure(
+            i->sample_spec.channels,
+            meter->statisticsWindow);
+    }
+    if(meter->showVectorscope)
+    {
+        meter->vectorscope.configure(
+            i->sample_spec.rate,
+            i->sample_spec.channels,
+            meter->vectorscopePair,
+            meter->framerateLimit);
+        if(!meter->vectorscope.isActive())
+        {
+            std::cerr << "WARNING: Not enough channels for vectorscope pair "
+                << meter->vectorscopePair << std::endl;
+        }
+    }
+    meter->analyzers.clear();
+    meter->analyzers.add(&meter->peakAnalyzer);
+    if(meter->showVectorscope && meter->vectorscope.isActive())
+    {
+        meter->analyzers.add(&meter->vectorscope);
+    }
+    if(meter->blackBox.isOpen())
+    {
+        meter->blackBox.configure(
+            i->sample_spec.rate,
+            i->sample_spec.channels);
+        meter->analyzers.add(&meter->blackBox);
+    }
+    if(meter->useAnalysisPipeline)
+    {
+        // analyzers are configured, from now on only the pipeline uses them
+        meter->pipeline.start(
+            meter->analysisThreads,
+            &meter->analyzers,
+            i->sample_spec.channels);
+        std::cout << "Analyzing on " << meter->pipeline.getThreads()
+            << " threads" << std::endl;
+    }
     pa_sample_spec sampleSpec;
     sampleSpec.format = PA_SAMPLE_FLOAT32LE;
     sampleSpec.rate = i->sample_spec.rate;
@@ -281,12 +444,43 @@ void MfPA::Meter::get_source_info_callback(
         meter->stream,
         MfPA::Meter::get_stream_data_callback,
         userdata);
-    pa_stream_connect_record(
+    pa_stream_set_suspended_callback(
         meter->stream,
-        i->name,
-        nullptr,
-//        PA_STREAM_NOFLAGS);
-        PA_STREAM_PEAK_DETECT);
+        MfPA::Meter::get_stream_interrupted_callback,
+        userdata);
+    pa_stream_set_moved_callback(
+        meter->stream,
+        MfPA::Meter::get_stream_interrupted_callback,
+        userdata);
+    if(meter->lowLatencyPacing)
+    {
+        // small fragments so the newest samples arrive before each frame
+        pa_buffer_attr bufferAttr;
+        std::memset(&bufferAttr, 0, sizeof(pa_buffer_attr));
+        bufferAttr.maxlength = (uint32_t) -1;
+        bufferAttr.fragsize = pa_usec_to_bytes(
+            METER_LOW_LATENCY_FRAGMENT_USEC,
+            &sampleSpec);
+        pa_stream_connect_record(
+            meter->stream,
+            i->name,
+            &bufferAttr,
+            (pa_stream_flags_t)(PA_STREAM_PEAK_DETECT
+                | PA_STREAM_ADJUST_LATENCY
+                | PA_STREAM_INTERPOLATE_TIMING
+                | PA_STREAM_AUTO_TIMING_UPDATE));
+    }
+    else
+    {
+        // timing updates give the latency that overrun detection needs
+        pa_stream_connect_record(
+            meter->stream,
+            i->name,
+            nullptr,
+            (pa_stream_flags_t)(PA_STREAM_PEAK_DETECT
+                | PA_STREAM_INTERPOLATE_TIMING
+                | PA_STREAM_AUTO_TIMING_UPDATE));
+    }
     meter->gotSourceInfo = true;
 #ifndef NDEBUG
     std::cout << "End get_source_info_callback" << std::endl;
@@ -305,8 +499,19 @@ void MfPA::Meter::get_stream_state_callback(pa_stream* s, void* userdata)
     case PA_STREAM_CREATING:
         break;
     case PA_STREAM_READY:
+    {
         meter->currentState = MfPA::Meter::READY;
+        // fragments are usually at most fragsize, larger ones grow a buffer
+        const pa_buffer_attr* bufferAttr = pa_stream_get_buffer_attr(s);
+        if(bufferAttr)
+        {
+            for(auto& block : meter->sampleBlocks)
+            {
+                block.reserve(bufferAttr->fragsize / sizeof(float));
+            }
+        }
         break;
+    }
     case PA_STREAM_FAILED:
         meter->currentState = MfPA::Meter::FAILED;
         std::cerr << "ERROR: Failed to get stream, ";
@@ -331,24 +536,397 @@ void MfPA::Meter::get_stream_data_callback(
 //    std::cout << "Begin get_stream_data_callback" << std::endl;
 #endif
     MfPA::Meter* meter = (MfPA::Meter*) userdata;
+#ifdef MFPA_ALLOCATION_AUDIT
+    AllocationAudit::Scope auditScope(AllocationAudit::CAPTURE);
+#endif
 
-    const void* data;
-    if(pa_stream_peek(s, &data, &nbytes) < 0)
+    // take every fragment that is readable, not just the first
+    uint64_t receivedFrames = 0;
+    while(true)
     {
-        std::cerr << pa_strerror(pa_context_errno(meter->context))
-            << std::endl;
+        const void* data;
+        if(pa_stream_peek(s, &data, &nbytes) < 0)
+        {
+            std::cerr << pa_strerror(pa_context_errno(meter->context))
+                << std::endl;
+            return;
+        }
+        if(!data)
+        {
+            if(nbytes == 0)
+            {
+                // nothing left, must not be dropped
+                break;
+            }
+            // a hole, samples are missing rather than silent
+            ++meter->captureGaps.holes;
+            meter->captureGaps.holeFrames +=
+                nbytes / sizeof(float) / meter->channels;
+            receivedFrames += nbytes / sizeof(float) / meter->channels;
+            meter->recordCaptureGap();
+            pa_stream_drop(s);
+            continue;
+        }
+
+        // if updates fell that far behind, the fragment is dropped
+        if(meter->sampleBlocksCount < METER_SAMPLE_BLOCKS)
+        {
+            std::vector<float>& block = meter->sampleBlocks[
+                (meter->sampleBlocksHead + meter->sampleBlocksCount)
+                % METER_SAMPLE_BLOCKS];
+            block.assign(
+                (const float*) data,
+                (const float*) data + nbytes / sizeof(float));
+            ++meter->sampleBlocksCount;
+        }
+        else
+        {
+            ++meter->captureGaps.droppedBlocks;
+            meter->captureGaps.droppedFrames +=
+                nbytes / sizeof(float) / meter->channels;
+            meter->recordCaptureGap();
+        }
+        receivedFrames += nbytes / sizeof(float) / meter->channels;
+        pa_stream_drop(s);
+    }
+    meter->checkOverrun(s, receivedFrames);
+
+    if(meter->lowLatencyPacing)
+    {
+        // newest sample in fragment was captured "latency" ago
+        pa_usec_t latency = 0;
+        int negative = 0;
+        if(pa_stream_get_latency(s, &latency, &negative) != 0 || negative)
+        {
+            latency = 0;
+        }
+        meter->newestSampleTime = std::chrono::steady_clock::now()
+            - std::chrono::microseconds(latency);
+    }
+#ifndef NDEBUG
+//    std::cout << "End get_stream_data_callback" << std::endl;
+#endif
+}
+
+void MfPA::Meter::get_stream_interrupted_callback(
+    pa_stream* s,
+    void* userdata)
+{
+    (void) s;
+    MfPA::Meter* meter = (MfPA::Meter*) userdata;
+    // nothing was captured while suspended or moving, which must not look
+    // like an overrun
+    meter->overrunCheckStarted = false;
+}
+
+void MfPA::Meter::get_subscribe_callback(
+    pa_context* c,
+    pa_subscription_event_type_t t,
+    uint32_t idx,
+    void* userdata)
+{
+    MfPA::Meter* meter = (MfPA::Meter*) userdata;
+#ifdef MFPA_ALLOCATION_AUDIT
+    // applications coming and going are not steady state
+    AllocationAudit::Scope auditScope(AllocationAudit::OTHER);
+#endif
+    if((t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK)
+        != PA_SUBSCRIPTION_EVENT_SINK_INPUT)
+    {
+        return;
+    }
+
+    switch(t & PA_SUBSCRIPTION_EVENT_TYPE_MASK)
+    {
+    case PA_SUBSCRIPTION_EVENT_NEW:
+    case PA_SUBSCRIPTION_EVENT_CHANGE:
+        pa_operation_unref(pa_context_get_sink_input_info(
+            c,
+            idx,
+            MfPA::Meter::get_sink_input_info_callback,
+            userdata));
+        break;
+    case PA_SUBSCRIPTION_EVENT_REMOVE:
+        for(auto iter = meter->applicationStreams.begin();
+            iter != meter->applicationStreams.end();
+            ++iter)
+        {
+            if((*iter)->sinkInputIndex == idx)
+            {
+                std::cout << "Stopped metering application \""
+                    << (*iter)->name << "\"" << std::endl;
+                meter->applicationStreams.erase(iter);
+                break;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void MfPA::Meter::get_sink_input_info_callback(
+    pa_context* c,
+    const pa_sink_input_info* i,
+    int eol,
+    void* userdata)
+{
+    MfPA::Meter* meter = (MfPA::Meter*) userdata;
+#ifdef MFPA_ALLOCATION_AUDIT
+    // applications coming and going are not steady state
+    AllocationAudit::Scope auditScope(AllocationAudit::OTHER);
+#endif
+    if(eol != PA_OK)
+    {
+        // end of list, or sink input vanished before query completed
         return;
     }
 
-    std::vector<float> v(nbytes/sizeof(float));
-    memcpy(v.data(), data, nbytes);
+    const char* name = pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME);
+    if(!name)
+    {
+        name = i->name;
+    }
 
-    meter->sampleQueue.push(std::move(v));
+    ApplicationStream* application = nullptr;
+    for(const auto& existing : meter->applicationStreams)
+    {
+        if(existing->sinkInputIndex == i->index)
+        {
+            application = existing.get();
+            break;
+        }
+    }
 
-    pa_stream_drop(s);
-#ifndef NDEBUG
-//    std::cout << "End get_stream_data_callback" << std::endl;
+    if(!application)
+    {
+        meter->applicationStreams.emplace_back(
+            new ApplicationStream(meter, i->index));
+        application = meter->applicationStreams.back().get();
+        std::cout << "Metering application \"" << name << "\"" << std::endl;
+    }
+    application->name = name;
+
+    // peaks are recorded at METER_APPLICATION_PEAK_RATE whatever the
+    // application's rate, so only a new channel layout needs a new stream
+    if(application->levels.empty()
+        || application->channels != i->sample_spec.channels
+        || !pa_channel_map_equal(&application->channelMap, &i->channel_map))
+    {
+        application->channels = i->sample_spec.channels;
+        application->channelMap = i->channel_map;
+        application->levels.assign(application->channels, Level());
+        application->ballistics.configure(
+            METER_APPLICATION_PEAK_RATE,
+            application->channels);
+        application->sinkIndex = PA_INVALID_INDEX;
+    }
+
+    if(application->sinkIndex != i->sink)
+    {
+        // new, moved to another sink, or changed layout, (re)connect to
+        // that sink's monitor
+        application->disconnect();
+        application->sinkIndex = i->sink;
+        pa_operation_unref(pa_context_get_sink_info_by_index(
+            c,
+            i->sink,
+            MfPA::Meter::get_application_sink_info_callback,
+            userdata));
+    }
+}
+
+void MfPA::Meter::get_application_sink_info_callback(
+    pa_context* c,
+    const pa_sink_info* i,
+    int eol,
+    void* userdata)
+{
+    MfPA::Meter* meter = (MfPA::Meter*) userdata;
+#ifdef MFPA_ALLOCATION_AUDIT
+    // applications coming and going are not steady state
+    AllocationAudit::Scope auditScope(AllocationAudit::OTHER);
 #endif
+    if(eol != PA_OK)
+    {
+        return;
+    }
+
+    for(const auto& application : meter->applicationStreams)
+    {
+        if(application->stream || application->sinkIndex != i->index)
+        {
+            continue;
+        }
+
+        // let the server reduce the stream to peaks at a low fixed rate so
+        // per application cost does not depend on its sample rate
+        pa_sample_spec sampleSpec;
+        sampleSpec.format = PA_SAMPLE_FLOAT32LE;
+        sampleSpec.rate = METER_APPLICATION_PEAK_RATE;
+        sampleSpec.channels = application->channels;
+        pa_buffer_attr bufferAttr;
+        std::memset(&bufferAttr, 0, sizeof(pa_buffer_attr));
+        bufferAttr.maxlength = (uint32_t) -1;
+        bufferAttr.fragsize = sizeof(float) * application->channels;
+
+        application->stream = pa_stream_new(
+            c,
+            "Meter for PulseAudio application stream",
+            &sampleSpec,
+            &application->channelMap);
+        if(!application->stream)
+        {
+            std::cerr << "WARNING: Failed to create stream for application \""
+                << application->name << "\", "
+                << pa_strerror(pa_context_errno(c)) << std::endl;
+            application->failed = true;
+            continue;
+        }
+        pa_stream_set_monitor_stream(
+            application->stream,
+            application->sinkInputIndex);
+        pa_stream_set_state_callback(
+            application->stream,
+            MfPA::Meter::get_application_stream_state_callback,
+            application.get());
+        pa_stream_set_read_callback(
+            application->stream,
+            MfPA::Meter::get_application_stream_data_callback,
+            application.get());
+
+        std::string monitorIndex = std::to_string(i->monitor_source);
+        pa_stream_connect_record(
+            application->stream,
+            monitorIndex.c_str(),
+            &bufferAttr,
+            (pa_stream_flags_t)(PA_STREAM_PEAK_DETECT
+                | PA_STREAM_ADJUST_LATENCY
+                | PA_STREAM_DONT_MOVE));
+    }
+}
+
+void MfPA::Meter::get_application_stream_state_callback(
+    pa_stream* s,
+    void* userdata)
+{
+    ApplicationStream* application = (ApplicationStream*) userdata;
+    if(pa_stream_get_state(s) == PA_STREAM_FAILED)
+    {
+        std::cerr << "WARNING: Failed to get stream for application \""
+            << application->name << "\", "
+            << pa_strerror(pa_context_errno(application->meter->context))
+            << std::endl;
+        // removed on next update, not from within its own callback
+        application->failed = true;
+    }
+}
+
+void MfPA::Meter::get_application_stream_data_callback(
+    pa_stream* s,
+    size_t nbytes,
+    void* userdata)
+{
+    ApplicationStream* application = (ApplicationStream*) userdata;
+
+    while(true)
+    {
+        const void* data;
+        if(pa_stream_peek(s, &data, &nbytes) < 0)
+        {
+            std::cerr
+                << pa_strerror(pa_context_errno(application->meter->context))
+                << std::endl;
+            return;
+        }
+        if(!data && nbytes == 0)
+        {
+            break;
+        }
+
+        // holes (no data) are skipped, samples are already peaks at
+        // METER_APPLICATION_PEAK_RATE
+        if(data)
+        {
+            application->ballistics.process(
+                (const float*) data,
+                nbytes / sizeof(float) / application->channels);
+        }
+        pa_stream_drop(s);
+    }
+}
+
+void MfPA::Meter::enableApplicationMetering()
+{
+    meterApplications = true;
+}
+
+void MfPA::Meter::setBallistics(Ballistics::Mode mode)
+{
+    ballisticsMode = mode;
+    peakAnalyzer.getBallistics().setMode(mode);
+}
+
+void MfPA::Meter::setScale(Scale::Type type)
+{
+    scale.setType(type);
+}
+
+void MfPA::Meter::enableVectorscope(unsigned int pair)
+{
+    showVectorscope = true;
+    vectorscopePair = pair;
+    scopeVertices.resize(VECTORSCOPE_MAX_POINTS);
+    if(window)
+    {
+        window->setSize(sf::Vector2u(METER_VECTORSCOPE_WINDOW_WIDTH, 400));
+    }
+}
+
+bool MfPA::Meter::enableEventDetector(
+    const std::string& target,
+    const EventDetector::Thresholds& thresholds)
+{
+    return events.open(target, thresholds);
+}
+
+bool MfPA::Meter::enableLevelServer(const char* socketPath)
+{
+    return levelServer.listen(socketPath);
+}
+
+void MfPA::Meter::enableAnalysisPipeline(
+    unsigned int threads,
+    bool printStageTimings)
+{
+    useAnalysisPipeline = true;
+    analysisThreads = threads;
+    this->printStageTimings = printStageTimings;
+    nextStageTimingReport = std::chrono::steady_clock::now()
+        + std::chrono::seconds(METER_STAGE_TIMING_REPORT_INTERVAL);
+}
+
+void MfPA::Meter::enableStatistics(float windowSeconds)
+{
+    statisticsWindow = windowSeconds;
+    std::signal(SIGUSR1, statisticsHandler);
+}
+
+bool MfPA::Meter::enableBlackBox(const BlackBoxRecorder::Settings& settings)
+{
+    BlackBoxRecorder::Settings meterSettings = settings;
+    meterSettings.clipLevel = METER_UPPER_LIMIT;
+    if(!blackBox.open(meterSettings))
+    {
+        return false;
+    }
+    std::signal(SIGUSR2, blackBoxHandler);
+    return true;
+}
+
+void MfPA::Meter::enableLowLatencyPacing()
+{
+    lowLatencyPacing = true;
 }
 
 void MfPA::Meter::startMainLoop()
@@ -356,38 +934,391 @@ void MfPA::Meter::startMainLoop()
 #ifndef NDEBUG
     levelsPrintTimer = 0.0f;
 #endif
+#ifdef MFPA_ALLOCATION_AUDIT
+    allocationWarmUpEnd = std::chrono::steady_clock::now()
+        + std::chrono::seconds(METER_ALLOCATION_WARM_UP);
+    nextAllocationReport = std::chrono::steady_clock::now()
+        + std::chrono::seconds(1);
+#endif
 
-    GDT::IntervalBasedGameLoop(
-        &runFlag,
-        [this] (float dt) {
-            update(dt);
-        },
-        [this] () {
-            draw();
-        },
-        framerateLimit,
-        1.0f / 120.0f);
+    if(lowLatencyPacing)
+    {
+        startPacedLoop();
+    }
+    else
+    {
+        GDT::IntervalBasedGameLoop(
+            &runFlag,
+            [this] (float dt) {
+                update(dt);
+            },
+            [this] () {
+                draw();
+            },
+            framerateLimit,
+            1.0f / 120.0f);
+    }
+
+    // nothing may write to the standard streams while the terminal restores
+    // them, then the terminal is restored first so the summary stays visible
+    pipeline.stop();
+    blackBox.stopWriter();
+    terminal.close();
+    if(statistics.isConfigured())
+    {
+        float coveredSeconds;
+        statistics.getPercentiles(statisticsSnapshot, coveredSeconds);
+        printStatistics(statisticsSnapshot, coveredSeconds);
+    }
+    char gaps[160];
+    if(formatCaptureGaps(gaps, sizeof(gaps)) > 0)
+    {
+        std::cout << "Capture " << gaps << std::endl;
+    }
 }
 
+void MfPA::Meter::startPacedLoop()
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<float> Seconds;
+
+    const Clock::duration frameInterval = std::chrono::duration_cast<
+        Clock::duration>(Seconds(
+            1.0f / (framerateLimit > 0 ? framerateLimit : 60)));
+
+    // durations of update + draw + present of the most recent frames
+    Clock::duration workDurations[METER_PACING_HISTORY];
+    for(unsigned int i = 0; i < METER_PACING_HISTORY; ++i)
+    {
+        workDurations[i] = Clock::duration::zero();
+    }
+    unsigned int workIndex = 0;
+
+    Clock::duration latencySum = Clock::duration::zero();
+    Clock::duration latencyMax = Clock::duration::zero();
+    unsigned int latencyCount = 0;
+    Clock::time_point nextReport = Clock::now()
+        + std::chrono::seconds(METER_LATENCY_REPORT_INTERVAL);
+
+    Clock::time_point previousFrame = Clock::now();
+    Clock::time_point nextPresent = previousFrame + frameInterval;
+    while(runFlag)
+    {
+        // start as late as possible so the newest levels get presented
+        Clock::duration predictedWork = workDurations[0];
+        for(unsigned int i = 1; i < METER_PACING_HISTORY; ++i)
+        {
+            if(predictedWork < workDurations[i])
+            {
+                predictedWork = workDurations[i];
+            }
+        }
+        predictedWork += std::chrono::microseconds(METER_PACING_MARGIN_USEC);
+        std::this_thread::sleep_until(nextPresent - predictedWork);
+
+        Clock::time_point frameStart = Clock::now();
+        update(std::chrono::duration_cast<Seconds>(
+            frameStart - previousFrame).count());
+        previousFrame = frameStart;
+        if(!runFlag)
+        {
+            break;
+        }
+        draw();
+        Clock::time_point presented = Clock::now();
+
+        workDurations[workIndex] = presented - frameStart;
+        workIndex = (workIndex + 1) % METER_PACING_HISTORY;
+
+        if(consumedSamples)
+        {
+            Clock::duration latency = presented - consumedSampleTime;
+            latencySum += latency;
+            if(latencyMax < latency)
+            {
+                latencyMax = latency;
+            }
+            ++latencyCount;
+        }
+
+        nextPresent += frameInterval;
+        if(nextPresent < presented)
+        {
+            // missed the predicted present time, resynchronize
+            nextPresent = presented + frameInterval;
+        }
+
+        if(presented >= nextReport)
+        {
+            if(latencyCount > 0)
+            {
+                std::cout << "Input to present latency: avg "
+                    << std::chrono::duration_cast<std::chrono::duration<
+                        float, std::milli>>(latencySum / latencyCount).count()
+                    << " ms, max "
+                    << std::chrono::duration_cast<std::chrono::duration<
+                        float, std::milli>>(latencyMax).count()
+                    << " ms, predicted frame work "
+                    << std::chrono::duration_cast<std::chrono::duration<
+                        float, std::milli>>(predictedWork).count()
+                    << " ms" << std::endl;
+            }
+            latencySum = Clock::duration::zero();
+            latencyMax = Clock::duration::zero();
+            latencyCount = 0;
+            nextReport = presented
+                + std::chrono::seconds(METER_LATENCY_REPORT_INTERVAL);
+        }
+    }
+}
+
+void MfPA::Meter::printStatistics(
+    const LevelStatistics::Percentiles* percentiles,
+    float coveredSeconds)
+{
+    LevelStatistics::print(
+        std::cout,
+        percentiles,
+        statistics.getChannels(),
+        coveredSeconds);
+}
+
+void MfPA::Meter::recordCaptureGap()
+{
+    hadCaptureGap = true;
+    lastCaptureGap = std::chrono::steady_clock::now();
+}
+
+void MfPA::Meter::checkOverrun(pa_stream* s, uint64_t frames)
+{
+    auto now = std::chrono::steady_clock::now();
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if(pa_stream_get_latency(s, &latency, &negative) != 0 || negative)
+    {
+        // no timing info yet
+        overrunCheckStarted = false;
+        return;
+    }
+    if(!overrunCheckStarted)
+    {
+        // frames of this call arrived before the start
+        overrunCheckStarted = true;
+        overrunCheckStart = now;
+        overrunCheckLatency = latency;
+        overrunCheckFrames = 0;
+        return;
+    }
+    overrunCheckFrames += frames;
+
+    double elapsed = std::chrono::duration_cast<
+        std::chrono::duration<double>>(now - overrunCheckStart).count();
+    double captured = (elapsed
+        - ((double)latency - (double)overrunCheckLatency) / 1000000.0)
+        * sampleRate;
+    double missing = captured - (double)overrunCheckFrames;
+    if(missing > METER_OVERRUN_THRESHOLD * sampleRate)
+    {
+        ++captureGaps.overruns;
+        captureGaps.overrunFrames += (uint64_t)missing;
+        recordCaptureGap();
+        overrunCheckStarted = false;
+    }
+    else if(missing < 0.0 || elapsed > METER_OVERRUN_CHECK_INTERVAL)
+    {
+        overrunCheckStarted = false;
+    }
+}
+
+float MfPA::Meter::getCaptureGapIndicator() const
+{
+    if(!hadCaptureGap)
+    {
+        return 0.0f;
+    }
+    float age = std::chrono::duration_cast<std::chrono::duration<float>>(
+        std::chrono::steady_clock::now() - lastCaptureGap).count();
+    return age < METER_CAPTURE_GAP_INDICATOR_TIME
+        ? 1.0f - age / METER_CAPTURE_GAP_INDICATOR_TIME : 0.0f;
+}
+
+int MfPA::Meter::formatCaptureGaps(char* text, std::size_t size) const
+{
+    if(!hadCaptureGap)
+    {
+        if(size > 0)
+        {
+            text[0] = '\0';
+        }
+        return 0;
+    }
+    return std::snprintf(text, size,
+        "gaps: %lu holes (%.0f ms), %lu overruns (~%.0f ms), "
+        "%lu dropped (%.0f ms)",
+        captureGaps.holes,
+        1000.0 * captureGaps.holeFrames / sampleRate,
+        captureGaps.overruns,
+        1000.0 * captureGaps.overrunFrames / sampleRate,
+        captureGaps.droppedBlocks,
+        1000.0 * captureGaps.droppedFrames / sampleRate);
+}
+
+MfPA::Meter::CaptureGaps::CaptureGaps() :
+holes(0),
+holeFrames(0),
+overruns(0),
+overrunFrames(0),
+droppedBlocks(0),
+droppedFrames(0)
+{}
+
 MfPA::Meter::Level::Level() :
 main(0.0f),
 prev(0.0f),
-prevTimer(0.0f),
-changed(false)
+prevTimer(0.0f)
 {}
 
+MfPA::Meter::ApplicationStream::ApplicationStream(
+    MfPA::Meter* meter,
+    uint32_t sinkInputIndex
+) :
+meter(meter),
+sinkInputIndex(sinkInputIndex),
+sinkIndex(PA_INVALID_INDEX),
+stream(nullptr),
+channels(0),
+ballistics(meter->ballisticsMode),
+failed(false)
+{}
+
+MfPA::Meter::ApplicationStream::~ApplicationStream()
+{
+    disconnect();
+}
+
+void MfPA::Meter::ApplicationStream::disconnect()
+{
+    if(stream)
+    {
+        // callbacks must not reach this object after it is gone
+        pa_stream_set_state_callback(stream, nullptr, nullptr);
+        pa_stream_set_read_callback(stream, nullptr, nullptr);
+        pa_stream_disconnect(stream);
+        pa_stream_unref(stream);
+        stream = nullptr;
+    }
+}
+
+void MfPA::Meter::readLevels(
+    const float* main,
+    const float* prev,
+    const float* prevTimer,
+    std::vector<Level>& levels)
+{
+    for(unsigned int i = 0; i < levels.size(); ++i)
+    {
+        levels[i].main = main[i];
+        levels[i].prev = prev[i];
+        levels[i].prevTimer = prevTimer[i];
+    }
+}
+
+void MfPA::Meter::finishBlock(const float* peaks, std::size_t frames)
+{
+    float seconds = (float)frames / (float)sampleRate;
+    if(events.isOpen())
+    {
+        events.process(peaks, seconds);
+    }
+    statistics.process(peaks, seconds);
+}
+
 void MfPA::Meter::update(float dt)
 {
-    pa_mainloop_iterate(mainLoop, 0, nullptr);
+#ifdef NDEBUG
+    // levels are integrated per sample, dt is only used for debug output
+    (void) dt;
+#endif
+#ifdef MFPA_ALLOCATION_AUDIT
+    {
+        auto now = std::chrono::steady_clock::now();
+        if(now >= nextAllocationReport)
+        {
+            uint64_t steadyState = AllocationAudit::getSteadyStateAllocations();
+            AllocationAudit::report(std::cout);
+            if(steadyState > 0)
+            {
+                std::cout << "WARNING: " << steadyState
+                    << " allocations after warm-up" << std::endl;
+            }
+            if(now >= allocationWarmUpEnd)
+            {
+                AllocationAudit::endWarmUp();
+            }
+            nextAllocationReport = now + std::chrono::seconds(1);
+        }
+    }
+    AllocationAudit::Scope auditScope(AllocationAudit::UPDATE);
+#endif
+    if(lowLatencyPacing)
+    {
+        // dispatch everything pending to get the newest samples
+        while(pa_mainloop_iterate(mainLoop, 0, nullptr) > 0) {}
+    }
+    else
+    {
+        pa_mainloop_iterate(mainLoop, 0, nullptr);
+    }
     if(currentState == TERMINATED || currentState == FAILED)
     {
         runFlag = false;
         return;
     }
+    else if(interrupted)
+    {
+        runFlag = false;
+        return;
+    }
+
+    levelServer.poll();
+
+    if(blackBoxSignalled)
+    {
+        blackBoxSignalled = 0;
+        blackBox.requestTrigger();
+    }
+
+    if(statistics.isConfigured())
+    {
+        if(statisticsSignalled)
+        {
+            statisticsSignalled = 0;
+            printStatisticsSnapshot = true;
+            statistics.requestSnapshot();
+        }
+        if(levelServer.takeStatisticsRequest())
+        {
+            statistics.requestSnapshot();
+        }
+
+        // taken by whichever thread analyzes, so ready on a later update
+        float coveredSeconds;
+        if(statistics.takeSnapshot(statisticsSnapshot, coveredSeconds))
+        {
+            if(printStatisticsSnapshot)
+            {
+                printStatisticsSnapshot = false;
+                printStatistics(statisticsSnapshot, coveredSeconds);
+            }
+            levelServer.publishStatistics(
+                (const float*) statisticsSnapshot,
+                statistics.getChannels());
+        }
+    }
 
     {
         sf::Event event;
-        while(window.pollEvent(event))
+        while(window && window->pollEvent(event))
         {
             if(event.type == sf::Event::Closed)
             {
@@ -400,56 +1331,93 @@ void MfPA::Meter::update(float dt)
     if(channelsChanged)
     {
         levels.resize(channels);
+        levelServerValues.resize(channels * 2);
         channelsChanged = false;
     }
 
-    for(unsigned int i = 0; i < channels; ++i)
+    consumedSamples = sampleBlocksCount > 0;
+    consumedSampleTime = newestSampleTime;
+    if(pipeline.isRunning())
     {
-        levels[i].changed = false;
-    }
+        for(; sampleBlocksCount > 0; --sampleBlocksCount)
+        {
+            const auto& block = sampleBlocks[sampleBlocksHead];
+            if(!pipeline.push(block.data(), block.size()))
+            {
+                ++captureGaps.droppedBlocks;
+                captureGaps.droppedFrames += block.size() / channels;
+                recordCaptureGap();
+            }
+            sampleBlocksHead = (sampleBlocksHead + 1) % METER_SAMPLE_BLOCKS;
+        }
 
-    while(!sampleQueue.empty())
-    {
+        if(printStageTimings)
         {
-            const auto& front = sampleQueue.front();
-            for(unsigned int i = 0; i < front.size(); ++i)
+            auto now = std::chrono::steady_clock::now();
+            if(now >= nextStageTimingReport)
             {
-                float fabs = std::abs(front[i]);
-                unsigned char currentChannel = i % channels;
-                if(levels[currentChannel].main < fabs)
-                {
-                    levels[currentChannel].main = fabs;
-                    levels[currentChannel].changed = true;
-                }
-                if(levels[currentChannel].prev <= fabs)
-                {
-                    levels[currentChannel].prev = fabs;
-                    levels[currentChannel].prevTimer = 1.0f;
-                }
+                pipeline.printStageTimings(std::cout);
+                nextStageTimingReport = now
+                    + std::chrono::seconds(METER_STAGE_TIMING_REPORT_INTERVAL);
             }
         }
-        sampleQueue.pop();
     }
+    else
+    {
+        for(; sampleBlocksCount > 0; --sampleBlocksCount)
+        {
+            const auto& block = sampleBlocks[sampleBlocksHead];
+            std::size_t frames = block.size() / channels;
+            analyzers.process(block.data(), frames, channels);
+            analyzers.publish();
+            sampleBlocksHead = (sampleBlocksHead + 1) % METER_SAMPLE_BLOCKS;
+        }
+    }
+    const PeakAnalyzer::Result& peaks = peakAnalyzer.getResult();
+    readLevels(peaks.levels, peaks.holds, peaks.holdRemaining, levels);
 
-    for(unsigned int i = 0; i < channels; ++i)
+    for(auto iter = applicationStreams.begin();
+        iter != applicationStreams.end(); )
     {
-        if(!levels[i].changed)
+        ApplicationStream& application = **iter;
+        if(application.failed)
         {
-            levels[i].main -= METER_DECAY_RATE * dt;
-            if(levels[i].main < 0.0f)
-            {
-                levels[i].main = 0.0f;
-            }
+#ifdef MFPA_ALLOCATION_AUDIT
+            AllocationAudit::Scope auditScope(AllocationAudit::OTHER);
+#endif
+            std::cout << "Stopped metering application \""
+                << application.name << "\"" << std::endl;
+            iter = applicationStreams.erase(iter);
+            continue;
         }
-        if(levels[i].prevTimer > 0.0f)
+        readLevels(
+            application.ballistics.getLevels(),
+            application.ballistics.getHolds(),
+            application.ballistics.getHoldRemaining(),
+            application.levels);
+        ++iter;
+    }
+
+    // updates follow the framerate when pacing for low latency, so records
+    // are limited to the documented rate instead of one per update
+    auto publishTime = std::chrono::steady_clock::now();
+    if(levelServer.isListening() && publishTime >= nextLevelServerPublish)
+    {
+        const auto publishInterval =
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / METER_LEVEL_SERVER_RATE));
+        nextLevelServerPublish += publishInterval;
+        // don't burst to catch up after a stall
+        if(nextLevelServerPublish < publishTime)
         {
-            levels[i].prevTimer -= METER_PREV_DECAY_RATE * dt;
-            if(levels[i].prevTimer <= 0.0f)
-            {
-                levels[i].prev = 0.0f;
-                levels[i].prevTimer = 0.0f;
-            }
+            nextLevelServerPublish = publishTime + publishInterval;
+        }
+        for(unsigned int i = 0; i < channels; ++i)
+        {
+            levelServerValues[i * 2] = levels[i].main;
+            levelServerValues[i * 2 + 1] = levels[i].prev;
         }
+        levelServer.publish(levelServerValues.data(), channels);
     }
 
 #ifndef NDEBUG
@@ -467,65 +1435,304 @@ void MfPA::Meter::update(float dt)
 #endif
 }
 
+void MfPA::Meter::drawLevels(
+    const std::vector<Level>& levels,
+    float x,
+    float columnWidth)
+{
+    for(unsigned int i = 0; i < levels.size(); ++i)
+    {
+        // prev levels
+        if(levels[i].prev >= METER_UPPER_LIMIT)
+        {
+            inverted.a = 255 * levels[i].prevTimer;
+            bar.setFillColor(inverted);
+            inverted.a = 255;
+        }
+        else
+        {
+            barColor.a = 255 * levels[i].prevTimer;
+            bar.setFillColor(barColor);
+            barColor.a = 255;
+        }
+        float height = scale.map(levels[i].prev);
+        bar.setSize(sf::Vector2f(
+            columnWidth,
+            height));
+        bar.setPosition(sf::Vector2f(
+            x + (float)i * columnWidth,
+            1.0f - height));
+        window->draw(bar);
+        // levels
+        height = scale.map(levels[i].main);
+        bar.setFillColor(barColor);
+        bar.setSize(sf::Vector2f(
+            columnWidth,
+            height));
+        bar.setPosition(sf::Vector2f(
+            x + (float)i * columnWidth,
+            1.0f - height));
+        window->draw(bar);
+    }
+}
+
+void MfPA::Meter::drawVectorscope(float x)
+{
+    // keep the scope square regardless of window shape
+    sf::Vector2u windowSize = window->getSize();
+    float centerX = x + (1.0f - x) / 2.0f;
+    float centerY = METER_VECTORSCOPE_HEIGHT / 2.0f;
+    float extentY = METER_VECTORSCOPE_HEIGHT / 2.0f;
+    float extentX = extentY * (float)windowSize.y / (float)windowSize.x;
+    if(extentX > (1.0f - x) / 2.0f)
+    {
+        extentY *= (1.0f - x) / 2.0f / extentX;
+        extentX = (1.0f - x) / 2.0f;
+    }
+
+    // axes, left and right channel are at 45 degrees
+    varray[0].position = sf::Vector2f(centerX, centerY - extentY);
+    varray[1].position = sf::Vector2f(centerX, centerY + extentY);
+    window->draw(varray);
+    varray[0].position = sf::Vector2f(centerX - extentX, centerY);
+    varray[1].position = sf::Vector2f(centerX + extentX, centerY);
+    window->draw(varray);
+
+    // all points as one batch, older points fade out
+    const Vectorscope::Result& scope = vectorscope.getResult();
+    std::size_t count = scope.pointCount;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        sf::Vertex& vertex = scopeVertices[i];
+        vertex.position.x = centerX + scope.pointsX[i] * extentX;
+        vertex.position.y = centerY - scope.pointsY[i] * extentY;
+        vertex.color = barColor;
+        vertex.color.a = 255 * (i + 1) / count;
+    }
+    window->draw(scopeVertices.data(), count, sf::PrimitiveType::Points);
+
+    // correlation, -1 at left to 1 at right
+    float correlation = scope.correlation;
+    float barY = METER_VECTORSCOPE_HEIGHT + (1.0f - METER_VECTORSCOPE_HEIGHT)
+        / 4.0f;
+    float barHeight = (1.0f - METER_VECTORSCOPE_HEIGHT) / 2.0f;
+    bar.setFillColor(correlation < 0.0f ? inverted : barColor);
+    bar.setSize(sf::Vector2f(
+        std::abs(correlation) * (1.0f - x) / 2.0f,
+        barHeight));
+    bar.setPosition(sf::Vector2f(
+        correlation < 0.0f
+            ? centerX + correlation * (1.0f - x) / 2.0f
+            : centerX,
+        barY));
+    window->draw(bar);
+    varray[0].position = sf::Vector2f(centerX, barY);
+    varray[1].position = sf::Vector2f(centerX, barY + barHeight);
+    window->draw(varray);
+}
+
 void MfPA::Meter::draw()
 {
-    window.clear();
+#ifdef MFPA_ALLOCATION_AUDIT
+    AllocationAudit::Scope auditScope(AllocationAudit::DRAW);
+#endif
+    if(window)
+    {
+        drawWindow();
+    }
+    else if(renderer == TERMINAL)
+    {
+        drawTerminal();
+    }
+}
+
+void MfPA::Meter::drawTerminalLevels(
+    const std::vector<Level>& levels,
+    float x,
+    float columnWidth,
+    unsigned int barRows)
+{
+    for(unsigned int i = 0; i < levels.size(); ++i)
+    {
+        unsigned int left = x + (float)i * columnWidth;
+        unsigned int right = x + (float)(i + 1) * columnWidth;
+        // one cell gap between wide enough bars
+        if(right - left >= 3)
+        {
+            --right;
+        }
+        else if(right == left)
+        {
+            right = left + 1;
+        }
+
+        unsigned int eighths = scale.map(levels[i].main) * barRows * 8.0f
+            + 0.5f;
+        for(unsigned int row = 0; row * 8 < eighths && row < barRows; ++row)
+        {
+            unsigned int filled = eighths - row * 8;
+            uint16_t glyph = BLOCK_GLYPHS[filled < 8 ? filled : 8];
+            for(unsigned int column = left; column < right; ++column)
+            {
+                terminal.set(column, barRows - 1 - row, glyph,
+                    TerminalRenderer::BAR);
+            }
+        }
+
+        // prev levels, above the bar only
+        unsigned int holdRow = scale.map(levels[i].prev) * barRows;
+        if(levels[i].prevTimer > 0.0f
+            && levels[i].prev > 0.0f
+            && holdRow * 8 >= eighths
+            && holdRow < barRows)
+        {
+            for(unsigned int column = left; column < right; ++column)
+            {
+                terminal.set(column, barRows - 1 - holdRow, HOLD_GLYPH,
+                    levels[i].prev >= METER_UPPER_LIMIT
+                        ? TerminalRenderer::PEAK
+                        : TerminalRenderer::BAR);
+            }
+        }
+    }
+}
+
+void MfPA::Meter::drawTerminal()
+{
+    terminal.beginFrame();
+    unsigned int columns = terminal.getColumns();
+    unsigned int rows = terminal.getRows();
 
     // don't draw until containers have been resized to channel amount
-    if(!channelsChanged)
+    if(!channelsChanged && rows >= 2)
     {
-        for(unsigned int i = 0; i < channels; ++i)
+        // last row shows what is metered
+        unsigned int barRows = rows - 1;
+
+        if(!hideMarkings)
         {
-            // prev levels
-            if(levels[i].prev >= METER_UPPER_LIMIT)
+            // drawn first so bars cover them
+            float upperLimit = scale.map(METER_UPPER_LIMIT);
+            unsigned int markingRow = upperLimit * barRows;
+            for(unsigned int x = 0; x < columns && markingRow < barRows; ++x)
             {
-                inverted.a = 255 * levels[i].prevTimer;
-                bar.setFillColor(inverted);
+                terminal.set(x, barRows - 1 - markingRow, MARKING_GLYPH,
+                    TerminalRenderer::MARKING);
             }
-            else
+            for(float marking : scale.getMarkings())
             {
-                barColor.a = 255 * levels[i].prevTimer;
-                bar.setFillColor(barColor);
-                barColor.a = 255;
+                markingRow = marking * barRows;
+                for(unsigned int x = 0;
+                    x < columns && markingRow < barRows;
+                    ++x)
+                {
+                    terminal.set(x, barRows - 1 - markingRow, MARKING_GLYPH,
+                        TerminalRenderer::MARKING);
+                }
             }
-            bar.setSize(sf::Vector2f(
-                1.0f / (float)channels,
-                levels[i].prev));
-            bar.setPosition(sf::Vector2f(
-                (float)i * 1.0f / (float)channels,
-                1.0f - levels[i].prev));
-            window.draw(bar);
-            // levels
-            bar.setFillColor(barColor);
-            bar.setSize(sf::Vector2f(
-                1.0f / (float)channels,
-                levels[i].main));
-            bar.setPosition(sf::Vector2f(
-                (float)i * 1.0f / (float)channels,
-                1.0f - levels[i].main));
-            window.draw(bar);
+        }
+
+        // same layout as the window, in cells
+        float groupColumns = channels;
+        for(const auto& application : applicationStreams)
+        {
+            groupColumns += METER_GROUP_GAP + application->levels.size();
+        }
+        float columnWidth = (float)columns / groupColumns;
+
+        drawTerminalLevels(levels, 0.0f, columnWidth, barRows);
+        float x = (float)channels * columnWidth;
+        for(const auto& application : applicationStreams)
+        {
+            x += METER_GROUP_GAP * columnWidth;
+            drawTerminalLevels(application->levels, x, columnWidth, barRows);
+            x += (float)application->levels.size() * columnWidth;
+        }
+
+        terminal.print(0, rows - 1, sinkOrSourceName.c_str(),
+            TerminalRenderer::DEFAULT);
+
+        // right aligned, highlighted while a gap is recent
+        char gaps[160];
+        int length = formatCaptureGaps(gaps, sizeof(gaps));
+        if(length > 0)
+        {
+            if((unsigned int)length >= sizeof(gaps))
+            {
+                length = sizeof(gaps) - 1;
+            }
+            terminal.print(
+                (unsigned int)length < columns ? columns - length : 0,
+                rows - 1,
+                gaps,
+                getCaptureGapIndicator() > 0.0f
+                    ? TerminalRenderer::PEAK
+                    : TerminalRenderer::DEFAULT);
+        }
+    }
+
+    terminal.present();
+}
+
+void MfPA::Meter::drawWindow()
+{
+    window->clear();
+
+    // don't draw until containers have been resized to channel amount
+    if(!channelsChanged)
+    {
+        // every application is a separate group of bars right of the
+        // sink/source bars, groups are separated by a gap
+        float columns = channels;
+        for(const auto& application : applicationStreams)
+        {
+            columns += METER_GROUP_GAP + application->levels.size();
+        }
+        float barsWidth = showVectorscope ? METER_VECTORSCOPE_BARS_WIDTH : 1.0f;
+        float columnWidth = barsWidth / columns;
+
+        drawLevels(levels, 0.0f, columnWidth);
+        float x = (float)channels * columnWidth;
+        for(const auto& application : applicationStreams)
+        {
+            x += METER_GROUP_GAP * columnWidth;
+            drawLevels(application->levels, x, columnWidth);
+            x += (float)application->levels.size() * columnWidth;
         }
 
         if(!hideMarkings)
         {
-            // draw lines at 0.75, 0.5, 0.25, and METER_UPPER_LIMIT
-            varray[0].position = sf::Vector2f(0.0f, 1.0f - METER_UPPER_LIMIT);
-            varray[1].position = sf::Vector2f(1.0f, 1.0f - METER_UPPER_LIMIT);
-            window.draw(varray);
+            // draw lines at METER_UPPER_LIMIT and the scale's markings
+            float upperLimit = scale.map(METER_UPPER_LIMIT);
+            varray[0].position = sf::Vector2f(0.0f, 1.0f - upperLimit);
+            varray[1].position = sf::Vector2f(barsWidth, 1.0f - upperLimit);
+            window->draw(varray);
 
-            varray[0].position = sf::Vector2f(0.0f, 0.25f);
-            varray[1].position = sf::Vector2f(1.0f, 0.25f);
-            window.draw(varray);
+            for(float marking : scale.getMarkings())
+            {
+                varray[0].position = sf::Vector2f(0.0f, 1.0f - marking);
+                varray[1].position = sf::Vector2f(barsWidth, 1.0f - marking);
+                window->draw(varray);
+            }
+        }
 
-            varray[0].position = sf::Vector2f(0.0f, 0.5f);
-            varray[1].position = sf::Vector2f(1.0f, 0.5f);
-            window.draw(varray);
+        if(showVectorscope)
+        {
+            drawVectorscope(barsWidth);
+        }
 
-            varray[0].position = sf::Vector2f(0.0f, 0.75f);
-            varray[1].position = sf::Vector2f(1.0f, 0.75f);
-            window.draw(varray);
+        // strip along the top of the bars fades out after a capture gap
+        float gapIndicator = getCaptureGapIndicator();
+        if(gapIndicator > 0.0f)
+        {
+            inverted.a = 255 * gapIndicator;
+            bar.setFillColor(inverted);
+            inverted.a = 255;
+            bar.setSize(sf::Vector2f(barsWidth, 0.015f));
+            bar.setPosition(sf::Vector2f(0.0f, 0.0f));
+            window->draw(bar);
         }
     }
 
-    window.display();
+    window->display();
 }
@@ -1,29 +1,87 @@
 #ifndef METER_FOR_PULSEAUDIO_HPP
 #define METER_FOR_PULSEAUDIO_HPP
 
-#define METER_DECAY_RATE 2.0f
-#define METER_PREV_DECAY_RATE 1.0f
 #define METER_UPPER_LIMIT 0.98f
+// rate of peaks received for each metered application
+#define METER_APPLICATION_PEAK_RATE 120
+// gap between groups of bars, in bar widths
+#define METER_GROUP_GAP 0.5f
+// window width when showing the vectorscope
+#define METER_VECTORSCOPE_WINDOW_WIDTH 500
+// part of window width used by bars when showing the vectorscope
+#define METER_VECTORSCOPE_BARS_WIDTH 0.2f
+// part of window height used by the vectorscope, correlation is below it
+#define METER_VECTORSCOPE_HEIGHT 0.9f
+// requested capture fragment size when pacing for low latency
+#define METER_LOW_LATENCY_FRAGMENT_USEC 5000
+// amount of frames whose durations predict the next frame's duration
+#define METER_PACING_HISTORY 16
+// extra time reserved before the predicted present time
+#define METER_PACING_MARGIN_USEC 1000
+// seconds between latency reports when pacing for low latency
+#define METER_LATENCY_REPORT_INTERVAL 5
+// seconds between reports of analysis time per stage
+#define METER_STAGE_TIMING_REPORT_INTERVAL 5
+// captured fragments that can wait for the next update
+#define METER_SAMPLE_BLOCKS 64
+// seconds a capture gap stays indicated
+#define METER_CAPTURE_GAP_INDICATOR_TIME 2.0f
+// seconds of captured audio that must be missing to count as an overrun,
+// above the jitter of fragment arrival and latency estimates
+#define METER_OVERRUN_THRESHOLD 0.2f
+// seconds after which overrun detection starts over, so drift between the
+// sound card's and the system's clock doesn't add up
+#define METER_OVERRUN_CHECK_INTERVAL 10
+// seconds after startup before allocations count as steady state, when
+// built with MFPA_ALLOCATION_AUDIT
+#define METER_ALLOCATION_WARM_UP 5
+// most level records pushed to level server subscribers per second
+#define METER_LEVEL_SERVER_RATE 120
 
-#include <queue>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <pulse/pulseaudio.h>
 
 #include <SFML/Graphics.hpp>
 
+#include "AnalysisPipeline.hpp"
+#include "Analyzer.hpp"
+#include "Ballistics.hpp"
+#include "BlackBoxRecorder.hpp"
+#include "EventDetector.hpp"
+#include "LevelServer.hpp"
+#include "LevelStatistics.hpp"
+#include "PeakAnalyzer.hpp"
+#include "Scale.hpp"
+#include "TerminalRenderer.hpp"
+#include "Vectorscope.hpp"
+
 namespace MfPA
 {
 
 class Meter
 {
 public:
+    enum Renderer
+    {
+        WINDOW,
+        TERMINAL,
+        // draws nothing, for events, level server, etc.
+        HEADLESS
+    };
+
     Meter(
         const char* sinkOrSourceName = "",
         bool isSink = true,
         unsigned int framerateLimit = 0,
         sf::Color barColor = sf::Color::Green,
-        bool hideMarkings = false
+        bool hideMarkings = false,
+        Renderer renderer = WINDOW
     );
     ~Meter();
 
@@ -55,6 +113,60 @@ public:
         pa_stream* s,
         size_t nbytes,
         void* userdata);
+    // used for pa_stream_set_suspended_callback and
+    // pa_stream_set_moved_callback
+    static void get_stream_interrupted_callback(pa_stream* s, void* userdata);
+    // used for pa_context_set_subscribe_callback
+    static void get_subscribe_callback(
+        pa_context* c,
+        pa_subscription_event_type_t t,
+        uint32_t idx,
+        void* userdata);
+    // used for pa_context_get_sink_input_info(_list)
+    static void get_sink_input_info_callback(
+        pa_context* c,
+        const pa_sink_input_info* i,
+        int eol,
+        void* userdata);
+    // used for pa_context_get_sink_info_by_index of an application's sink
+    static void get_application_sink_info_callback(
+        pa_context* c,
+        const pa_sink_info* i,
+        int eol,
+        void* userdata);
+    // used for pa_stream_set_state_callback of application streams
+    static void get_application_stream_state_callback(
+        pa_stream* s,
+        void* userdata);
+    // used for pa_stream_set_read_callback of application streams
+    static void get_application_stream_data_callback(
+        pa_stream* s,
+        size_t nbytes,
+        void* userdata);
+
+    void setBallistics(Ballistics::Mode mode);
+    void setScale(Scale::Type type);
+    // show correlation and goniometer of the given channel pair
+    void enableVectorscope(unsigned int pair);
+    // also meter every application (sink input) as its own group of bars
+    void enableApplicationMetering();
+    // present frames as late as possible instead of at a fixed interval
+    void enableLowLatencyPacing();
+    // returns false if target is invalid, see EventDetector::open
+    bool enableEventDetector(
+        const std::string& target,
+        const EventDetector::Thresholds& thresholds);
+    // returns false if unable to listen on the given socket path
+    bool enableLevelServer(const char* socketPath);
+    // level percentiles over a sliding window, printed on SIGUSR1 and on
+    // exit, and sent to level server subscribers that request them
+    void enableStatistics(float windowSeconds);
+    // writes audio around clips, silence, and SIGUSR2 to files, returns
+    // false if the directory is not writable, see BlackBoxRecorder
+    bool enableBlackBox(const BlackBoxRecorder::Settings& settings);
+    // analyze captured samples on a pool of threads instead of the drawing
+    // thread, threads of 0 uses one per core
+    void enableAnalysisPipeline(unsigned int threads, bool printStageTimings);
 
     void startMainLoop();
 
@@ -69,7 +181,9 @@ private:
     };
     CurrentState currentState;
     bool isMonitoringSink;
-    const char* sinkOrSourceName;
+    // copied, the server info holding the default's name is freed after its
+    // callback
+    std::string sinkOrSourceName;
     unsigned int framerateLimit;
 
     bool gotSinkInfo;
@@ -79,12 +193,45 @@ private:
     pa_context* context;
     pa_stream* stream;
 
-    std::queue<std::vector<float>> sampleQueue;
+    // ring of captured fragments, buffers are reused so capturing doesn't
+    // allocate once every buffer is large enough for a fragment
+    std::vector<float> sampleBlocks[METER_SAMPLE_BLOCKS];
+    std::size_t sampleBlocksHead;
+    std::size_t sampleBlocksCount;
+
+    // samples missing from what was metered, to tell real silence from
+    // capturing falling behind
+    struct CaptureGaps
+    {
+        CaptureGaps();
+
+        // holes reported by the server in the stream
+        unsigned long holes;
+        uint64_t holeFrames;
+        // the server's record buffer overran, the amount lost is estimated
+        unsigned long overruns;
+        uint64_t overrunFrames;
+        // fragments dropped because updates or analysis fell behind
+        unsigned long droppedBlocks;
+        uint64_t droppedFrames;
+    };
+    CaptureGaps captureGaps;
+    bool hadCaptureGap;
+    std::chrono::steady_clock::time_point lastCaptureGap;
+    // PulseAudio doesn't report overruns of record streams, so frames
+    // received since overrunCheckStart are compared with what the source
+    // captured meanwhile, which is the elapsed time minus the growth of the
+    // stream's latency
+    bool overrunCheckStarted;
+    std::chrono::steady_clock::time_point overrunCheckStart;
+    pa_usec_t overrunCheckLatency;
+    uint64_t overrunCheckFrames;
 
     bool runFlag;
 
     unsigned char channels;
     bool channelsChanged;
+    unsigned int sampleRate;
 
     struct Level
     {
@@ -93,24 +240,125 @@ private:
         float main;
         float prev;
         float prevTimer;
-        bool changed;
     };
 
+    PeakAnalyzer peakAnalyzer;
     std::vector<Level> levels;
 
-    sf::RenderWindow window;
+    struct ApplicationStream
+    {
+        ApplicationStream(Meter* meter, uint32_t sinkInputIndex);
+        ~ApplicationStream();
+
+        void disconnect();
+
+        Meter* meter;
+        uint32_t sinkInputIndex;
+        uint32_t sinkIndex;
+        std::string name;
+        pa_stream* stream;
+        unsigned char channels;
+        pa_channel_map channelMap;
+        Ballistics ballistics;
+        bool failed;
+        std::vector<Level> levels;
+    };
+
+    std::vector<std::unique_ptr<ApplicationStream>> applicationStreams;
+
+    Renderer renderer;
+    // only created when renderer is WINDOW
+    std::unique_ptr<sf::RenderWindow> window;
+    TerminalRenderer terminal;
     sf::RectangleShape bar;
     sf::Color barColor;
     sf::Color inverted;
     sf::VertexArray varray;
 
     bool hideMarkings;
+    Ballistics::Mode ballisticsMode;
+    Scale scale;
+
+    bool showVectorscope;
+    unsigned int vectorscopePair;
+    Vectorscope vectorscope;
+    std::vector<sf::Vertex> scopeVertices;
+    bool meterApplications;
+    bool lowLatencyPacing;
+
+    // capture time of newest received sample
+    std::chrono::steady_clock::time_point newestSampleTime;
+    // capture time of newest sample used by the last update
+    std::chrono::steady_clock::time_point consumedSampleTime;
+    bool consumedSamples;
+
+    EventDetector events;
+    LevelServer levelServer;
+    std::vector<float> levelServerValues;
+    std::chrono::steady_clock::time_point nextLevelServerPublish;
+
+    float statisticsWindow;
+    LevelStatistics statistics;
+    LevelStatistics::Percentiles statisticsSnapshot[
+        LEVEL_STATISTICS_MAX_CHANNELS];
+    // pending snapshot was requested by SIGUSR1 and is printed, snapshots
+    // requested by level server subscribers are only sent to them
+    bool printStatisticsSnapshot;
+
+    bool useAnalysisPipeline;
+    unsigned int analysisThreads;
+    bool printStageTimings;
+    std::chrono::steady_clock::time_point nextStageTimingReport;
+    BlackBoxRecorder blackBox;
+
+    // peak analyzer first, then the vectorscope if shown, then the black box
+    AnalyzerChain analyzers;
+    // uses the analyzers above, so it's stopped before they are destroyed
+    AnalysisPipeline pipeline;
 
 #ifndef NDEBUG
     float levelsPrintTimer;
 #endif
+#ifdef MFPA_ALLOCATION_AUDIT
+    std::chrono::steady_clock::time_point allocationWarmUpEnd;
+    std::chrono::steady_clock::time_point nextAllocationReport;
+#endif
+
+    static void readLevels(
+        const float* main,
+        const float* prev,
+        const float* prevTimer,
+        std::vector<Level>& levels);
+
+    // events and statistics of a block after the peak analyzer processed it
+    void finishBlock(const float* peaks, std::size_t frames);
+
+    void recordCaptureGap();
+    // frames arrived in the stream, including holes, since the last call
+    void checkOverrun(pa_stream* s, uint64_t frames);
+    // 1 right after a gap, fading to 0 after METER_CAPTURE_GAP_INDICATOR_TIME
+    float getCaptureGapIndicator() const;
+    // returns length written like snprintf, nothing if there were no gaps
+    int formatCaptureGaps(char* text, std::size_t size) const;
+
+    void printStatistics(
+        const LevelStatistics::Percentiles* percentiles,
+        float coveredSeconds);
 
+    void startPacedLoop();
     void update(float dt);
+    void drawLevels(
+        const std::vector<Level>& levels,
+        float x,
+        float columnWidth);
+    void drawVectorscope(float x);
+    void drawWindow();
+    void drawTerminalLevels(
+        const std::vector<Level>& levels,
+        float x,
+        float columnWidth,
+        unsigned int barRows);
+    void drawTerminal();
     void draw();
 
 };
@@ -0,0 +1,69 @@
+#include "PeakAnalyzer.hpp"
+
+#include <algorithm>
+
+MfPA::PeakAnalyzer::Result::Result() :
+channels(0)
+{
+    std::fill(levels, levels + BALLISTICS_MAX_CHANNELS, 0.0f);
+    std::fill(holds, holds + BALLISTICS_MAX_CHANNELS, 0.0f);
+    std::fill(holdRemaining, holdRemaining + BALLISTICS_MAX_CHANNELS, 0.0f);
+    std::fill(peaks, peaks + BALLISTICS_MAX_CHANNELS, 0.0f);
+}
+
+MfPA::PeakAnalyzer::PeakAnalyzer() :
+blockFrames(0)
+{}
+
+MfPA::Ballistics& MfPA::PeakAnalyzer::getBallistics()
+{
+    return ballistics;
+}
+
+void MfPA::PeakAnalyzer::setBlockCallback(BlockCallback analyzed)
+{
+    this->analyzed = analyzed;
+}
+
+const char* MfPA::PeakAnalyzer::getName() const
+{
+    return "peaks";
+}
+
+void MfPA::PeakAnalyzer::process(
+    const float* samples,
+    std::size_t frames,
+    unsigned char /* channels */)
+{
+    ballistics.process(samples, frames);
+    blockFrames += frames;
+}
+
+void MfPA::PeakAnalyzer::publish()
+{
+    Result& result = results.getWriteBuffer();
+    unsigned char channels = ballistics.getChannels();
+    result.channels = channels;
+    std::copy(ballistics.getLevels(), ballistics.getLevels() + channels,
+        result.levels);
+    std::copy(ballistics.getHolds(), ballistics.getHolds() + channels,
+        result.holds);
+    std::copy(ballistics.getHoldRemaining(),
+        ballistics.getHoldRemaining() + channels,
+        result.holdRemaining);
+    std::copy(ballistics.getPeaks(), ballistics.getPeaks() + channels,
+        result.peaks);
+    results.publish();
+
+    if(analyzed && blockFrames > 0)
+    {
+        analyzed(ballistics.getPeaks(), blockFrames);
+    }
+    blockFrames = 0;
+    ballistics.resetPeaks();
+}
+
+const MfPA::PeakAnalyzer::Result& MfPA::PeakAnalyzer::getResult()
+{
+    return results.acquire();
+}
@@ -0,0 +1,67 @@
+#ifndef PEAK_ANALYZER_HPP
+#define PEAK_ANALYZER_HPP
+
+#include <cstddef>
+#include <functional>
+
+#include "Analyzer.hpp"
+#include "Ballistics.hpp"
+#include "TripleBuffer.hpp"
+
+namespace MfPA
+{
+
+/*
+ * Meter levels and peaks of every channel, using Ballistics.
+ */
+class PeakAnalyzer : public Analyzer
+{
+public:
+    struct Result
+    {
+        Result();
+
+        unsigned char channels;
+        // see Ballistics
+        float levels[BALLISTICS_MAX_CHANNELS];
+        float holds[BALLISTICS_MAX_CHANNELS];
+        float holdRemaining[BALLISTICS_MAX_CHANNELS];
+        // highest absolute sample of each channel in the last block
+        float peaks[BALLISTICS_MAX_CHANNELS];
+    };
+
+    // called with the highest absolute sample of each channel and the frame
+    // count of every block before it is published, on the analyzing thread
+    typedef std::function<void(const float* peaks, std::size_t frames)>
+        BlockCallback;
+
+    PeakAnalyzer();
+
+    // configure and set mode through this before analyzing
+    Ballistics& getBallistics();
+    // must not be set while analyzing
+    void setBlockCallback(BlockCallback analyzed);
+
+    const char* getName() const override;
+    void process(
+        const float* samples,
+        std::size_t frames,
+        unsigned char channels) override;
+    // also calls the block callback and resets block peaks
+    void publish() override;
+
+    // newest published result, only from one reading thread
+    const Result& getResult();
+
+private:
+    Ballistics ballistics;
+    TripleBuffer<Result> results;
+    BlockCallback analyzed;
+    // processed since the last publish
+    std::size_t blockFrames;
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,114 @@
+#include "Scale.hpp"
+
+#include <cmath>
+
+MfPA::Scale::Scale(Type type)
+{
+    // 20 * log10(mantissa), mantissa in [0.5, 1)
+    for(unsigned int i = 0; i < SCALE_TABLE_SIZE; ++i)
+    {
+        float mantissa = 0.5f + (i + 0.5f) * 0.5f / SCALE_TABLE_SIZE;
+        decibelTable[i] = 20.0f * std::log10(mantissa);
+    }
+    setType(type);
+}
+
+bool MfPA::Scale::parseType(const std::string& name, Type& type)
+{
+    if(name == "linear")
+    {
+        type = LINEAR;
+    }
+    else if(name == "db40")
+    {
+        type = DB_40;
+    }
+    else if(name == "db60")
+    {
+        type = DB_60;
+    }
+    else if(name == "db90")
+    {
+        type = DB_90;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void MfPA::Scale::setType(Type type)
+{
+    this->type = type;
+    markings.clear();
+
+    float step;
+    switch(type)
+    {
+    case LINEAR:
+        floor = 0.0f;
+        markings.push_back(0.25f);
+        markings.push_back(0.5f);
+        markings.push_back(0.75f);
+        return;
+    case DB_40:
+        floor = -40.0f;
+        step = 6.0f;
+        break;
+    case DB_60:
+        floor = -60.0f;
+        step = 10.0f;
+        break;
+    case DB_90:
+    default:
+        floor = -90.0f;
+        step = 10.0f;
+        break;
+    }
+
+    for(float decibels = 0.0f; decibels > floor; decibels -= step)
+    {
+        markings.push_back(1.0f - decibels / floor);
+    }
+}
+
+MfPA::Scale::Type MfPA::Scale::getType() const
+{
+    return type;
+}
+
+float MfPA::Scale::map(float amplitude) const
+{
+    if(type == LINEAR)
+    {
+        return amplitude < 1.0f ? amplitude : 1.0f;
+    }
+    else if(!(amplitude > 0.0f))
+    {
+        return 0.0f;
+    }
+    else if(!(amplitude < 1.0f))
+    {
+        // also keeps infinity away from the table lookup
+        return 1.0f;
+    }
+
+    int exponent;
+    float mantissa = std::frexp(amplitude, &exponent);
+    float decibels = decibelTable[
+        (unsigned int)((mantissa - 0.5f) * (2.0f * SCALE_TABLE_SIZE))]
+        + exponent * 6.0206f;
+
+    float position = 1.0f - decibels / floor;
+    if(position < 0.0f)
+    {
+        return 0.0f;
+    }
+    return position < 1.0f ? position : 1.0f;
+}
+
+const std::vector<float>& MfPA::Scale::getMarkings() const
+{
+    return markings;
+}
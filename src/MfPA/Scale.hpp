@@ -0,0 +1,54 @@
+#ifndef SCALE_HPP
+#define SCALE_HPP
+
+// entries of the decibel table over a mantissa in [0.5, 1)
+#define SCALE_TABLE_SIZE 256
+
+#include <string>
+#include <vector>
+
+namespace MfPA
+{
+
+/*
+ * Maps linear amplitude to a position on the meter in [0, 1].
+ *
+ * Decibel scales split amplitude into mantissa and exponent, so a lookup in a
+ * precomputed table plus a multiply-add replaces a logarithm per bar.
+ */
+class Scale
+{
+public:
+    enum Type
+    {
+        LINEAR,
+        DB_40,
+        DB_60,
+        DB_90
+    };
+
+    Scale(Type type = LINEAR);
+
+    // returns false if name does not match any type
+    static bool parseType(const std::string& name, Type& type);
+
+    void setType(Type type);
+    Type getType() const;
+
+    float map(float amplitude) const;
+
+    // positions of marking lines for this scale
+    const std::vector<float>& getMarkings() const;
+
+private:
+    Type type;
+    // lowest shown level in dBFS, 0 for LINEAR
+    float floor;
+    float decibelTable[SCALE_TABLE_SIZE];
+    std::vector<float> markings;
+
+};
+
+} // namespace MfPA
+
+#endif
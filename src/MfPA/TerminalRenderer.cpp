@@ -0,0 +1,368 @@
+#include "TerminalRenderer.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace
+{
+
+// glyph of a cell that must be redrawn
+const uint16_t INVALID_GLYPH = 0xFFFF;
+
+} // namespace
+
+MfPA::TerminalRenderer::TerminalRenderer() :
+isOpen(false),
+columns(0),
+rows(0),
+clearScreen(true),
+shownColor(-1),
+outCapture(*this, std::cout),
+errCapture(*this, std::cerr),
+logCapture(*this, std::clog)
+{
+    status[0] = '\0';
+    for(unsigned int i = 0; i < COLOR_COUNT; ++i)
+    {
+        colorSequences[i] = "\x1b[39m";
+    }
+}
+
+MfPA::TerminalRenderer::~TerminalRenderer()
+{
+    close();
+}
+
+bool MfPA::TerminalRenderer::open()
+{
+    if(!isatty(STDOUT_FILENO))
+    {
+        std::cerr << "ERROR: stdout is not a terminal" << std::endl;
+        return false;
+    }
+
+    // alternate screen, hide cursor
+    output = "\x1b[?1049h\x1b[?25l";
+    write();
+    isOpen = true;
+    clearScreen = true;
+    shownColor = -1;
+    outCapture.start();
+    errCapture.start();
+    logCapture.start();
+    return true;
+}
+
+void MfPA::TerminalRenderer::close()
+{
+    if(!isOpen)
+    {
+        return;
+    }
+
+    // reset attributes, show cursor, leave alternate screen
+    output = "\x1b[0m\x1b[?25h\x1b[?1049l";
+    write();
+    isOpen = false;
+    outCapture.stop();
+    errCapture.stop();
+    logCapture.stop();
+}
+
+void MfPA::TerminalRenderer::setColor(
+    Color color,
+    uint8_t r,
+    uint8_t g,
+    uint8_t b)
+{
+    char sequence[32];
+    std::snprintf(sequence, sizeof(sequence), "\x1b[38;2;%u;%u;%um",
+        (unsigned int)r, (unsigned int)g, (unsigned int)b);
+    colorSequences[color] = sequence;
+    shownColor = -1;
+}
+
+void MfPA::TerminalRenderer::beginFrame()
+{
+    winsize size;
+    unsigned int newColumns = 80;
+    unsigned int newRows = 24;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0
+        && size.ws_col > 0 && size.ws_row > 0)
+    {
+        newColumns = size.ws_col;
+        newRows = size.ws_row;
+    }
+    if(newColumns > TERMINAL_RENDERER_MAX_COLUMNS)
+    {
+        newColumns = TERMINAL_RENDERER_MAX_COLUMNS;
+    }
+    if(newRows > TERMINAL_RENDERER_MAX_ROWS)
+    {
+        newRows = TERMINAL_RENDERER_MAX_ROWS;
+    }
+
+    if(newColumns != columns || newRows != rows)
+    {
+        columns = newColumns;
+        rows = newRows;
+        frame.resize(columns * rows);
+        shown.resize(columns * rows);
+        clearScreen = true;
+    }
+
+    for(auto& cell : frame)
+    {
+        cell.glyph = ' ';
+        cell.color = DEFAULT;
+    }
+}
+
+unsigned int MfPA::TerminalRenderer::getColumns() const
+{
+    return columns;
+}
+
+unsigned int MfPA::TerminalRenderer::getRows() const
+{
+    return rows;
+}
+
+void MfPA::TerminalRenderer::set(
+    unsigned int x,
+    unsigned int y,
+    uint16_t glyph,
+    Color color)
+{
+    if(x < columns && y < rows)
+    {
+        frame[y * columns + x].glyph = glyph;
+        frame[y * columns + x].color = color;
+    }
+}
+
+void MfPA::TerminalRenderer::print(
+    unsigned int x,
+    unsigned int y,
+    const char* text,
+    Color color)
+{
+    for(; *text != '\0' && x < columns; ++text, ++x)
+    {
+        // only ASCII, anything else is shown as '?'
+        set(x, y, (unsigned char)*text < 0x80 ? *text : '?', color);
+    }
+}
+
+void MfPA::TerminalRenderer::present()
+{
+    if(!isOpen)
+    {
+        return;
+    }
+
+    // latest captured line over the bottom row
+    if(rows > 0)
+    {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        if(status[0] != '\0' && std::chrono::steady_clock::now() < statusEnd)
+        {
+            for(unsigned int x = 0; x < columns; ++x)
+            {
+                set(x, rows - 1, ' ', DEFAULT);
+            }
+            print(0, rows - 1, status, DEFAULT);
+        }
+    }
+
+    output.clear();
+    if(clearScreen)
+    {
+        output += "\x1b[2J";
+        for(auto& cell : shown)
+        {
+            cell.glyph = INVALID_GLYPH;
+        }
+        clearScreen = false;
+    }
+
+    unsigned int cursorX = columns;
+    unsigned int cursorY = rows;
+    for(unsigned int y = 0; y < rows; ++y)
+    {
+        for(unsigned int x = 0; x < columns; ++x)
+        {
+            const Cell& cell = frame[y * columns + x];
+            Cell& shownCell = shown[y * columns + x];
+            if(cell.glyph == shownCell.glyph && cell.color == shownCell.color)
+            {
+                continue;
+            }
+
+            if(x != cursorX || y != cursorY)
+            {
+                char move[24];
+                std::snprintf(move, sizeof(move), "\x1b[%u;%uH", y + 1, x + 1);
+                output += move;
+            }
+            if(cell.color != shownColor)
+            {
+                output += colorSequences[cell.color];
+                shownColor = cell.color;
+            }
+            appendGlyph(cell.glyph);
+            shownCell = cell;
+            cursorX = x + 1;
+            cursorY = y;
+        }
+    }
+
+    write();
+}
+
+void MfPA::TerminalRenderer::appendGlyph(uint16_t glyph)
+{
+    // UTF-8
+    if(glyph < 0x80)
+    {
+        output += (char)glyph;
+    }
+    else if(glyph < 0x800)
+    {
+        output += (char)(0xC0 | (glyph >> 6));
+        output += (char)(0x80 | (glyph & 0x3F));
+    }
+    else
+    {
+        output += (char)(0xE0 | (glyph >> 12));
+        output += (char)(0x80 | ((glyph >> 6) & 0x3F));
+        output += (char)(0x80 | (glyph & 0x3F));
+    }
+}
+
+void MfPA::TerminalRenderer::write()
+{
+    std::size_t written = 0;
+    while(written < output.size())
+    {
+        ssize_t n = ::write(
+            STDOUT_FILENO,
+            output.data() + written,
+            output.size() - written);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        written += n;
+    }
+}
+
+MfPA::TerminalRenderer::Capture::Capture(
+    TerminalRenderer& renderer,
+    std::ostream& stream) :
+renderer(renderer),
+stream(stream),
+original(nullptr),
+lineCount(0),
+length(0)
+{}
+
+void MfPA::TerminalRenderer::Capture::start()
+{
+    std::lock_guard<std::mutex> lock(renderer.statusMutex);
+    lineCount = 0;
+    length = 0;
+    original = stream.rdbuf(this);
+}
+
+void MfPA::TerminalRenderer::Capture::stop()
+{
+    std::lock_guard<std::mutex> lock(renderer.statusMutex);
+    if(!original)
+    {
+        return;
+    }
+    stream.rdbuf(original);
+
+    if(length > 0)
+    {
+        finishLine();
+    }
+    unsigned long first = 0;
+    if(lineCount > TERMINAL_RENDERER_LOG_LINES)
+    {
+        first = lineCount - TERMINAL_RENDERER_LOG_LINES;
+        char dropped[64];
+        int droppedLength = std::snprintf(dropped, sizeof(dropped),
+            "(%lu earlier lines not kept)\n", first);
+        original->sputn(dropped, droppedLength);
+    }
+    for(unsigned long i = first; i < lineCount; ++i)
+    {
+        const char* line = lines[i % TERMINAL_RENDERER_LOG_LINES];
+        original->sputn(line, std::strlen(line));
+        original->sputc('\n');
+    }
+    original->pubsync();
+    original = nullptr;
+}
+
+MfPA::TerminalRenderer::Capture::int_type
+MfPA::TerminalRenderer::Capture::overflow(int_type c)
+{
+    if(traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+    std::lock_guard<std::mutex> lock(renderer.statusMutex);
+    put(traits_type::to_char_type(c));
+    return c;
+}
+
+std::streamsize MfPA::TerminalRenderer::Capture::xsputn(
+    const char* text,
+    std::streamsize count)
+{
+    std::lock_guard<std::mutex> lock(renderer.statusMutex);
+    for(std::streamsize i = 0; i < count; ++i)
+    {
+        put(text[i]);
+    }
+    return count;
+}
+
+void MfPA::TerminalRenderer::Capture::put(char c)
+{
+    if(c == '\n')
+    {
+        finishLine();
+    }
+    // tabs and other control characters would move the cursor
+    else if((unsigned char)c >= 0x20
+        && length + 1 < TERMINAL_RENDERER_LINE_LENGTH)
+    {
+        lines[lineCount % TERMINAL_RENDERER_LOG_LINES][length++] = c;
+    }
+}
+
+void MfPA::TerminalRenderer::Capture::finishLine()
+{
+    char* line = lines[lineCount % TERMINAL_RENDERER_LOG_LINES];
+    line[length] = '\0';
+    ++lineCount;
+    length = 0;
+
+    std::strcpy(renderer.status, line);
+    renderer.statusEnd = std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<float>(TERMINAL_RENDERER_STATUS_TIME));
+}
@@ -0,0 +1,135 @@
+#ifndef TERMINAL_RENDERER_HPP
+#define TERMINAL_RENDERER_HPP
+
+// limits of the framebuffer, larger terminals are partially used
+#define TERMINAL_RENDERER_MAX_COLUMNS 512
+#define TERMINAL_RENDERER_MAX_ROWS 256
+// seconds a line written to a standard stream is shown on the bottom row
+#define TERMINAL_RENDERER_STATUS_TIME 5.0f
+// latest lines written to each standard stream, written out on close
+#define TERMINAL_RENDERER_LOG_LINES 32
+// longer lines are cut
+#define TERMINAL_RENDERER_LINE_LENGTH 256
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace MfPA
+{
+
+/*
+ * Draws cells to an ANSI terminal on stdout.
+ *
+ * A shadow copy of what the terminal shows is kept, so presenting a frame
+ * only writes cells that changed, with all escape sequences of the frame
+ * batched into one write.
+ *
+ * While open, std::cout, std::cerr and std::clog are captured so output from
+ * anywhere, including other threads, can't garble the screen. The latest
+ * line is shown over the bottom row for a few seconds, and the latest lines
+ * of each stream are written to it on close.
+ */
+class TerminalRenderer
+{
+public:
+    enum Color
+    {
+        DEFAULT,
+        BAR,
+        PEAK,
+        MARKING,
+        COLOR_COUNT
+    };
+
+    TerminalRenderer();
+    ~TerminalRenderer();
+
+    // returns false if stdout is not a terminal
+    bool open();
+    // restores the terminal and the standard streams, called by destructor,
+    // other threads must not write to the streams meanwhile
+    void close();
+
+    void setColor(Color color, uint8_t r, uint8_t g, uint8_t b);
+
+    // follows terminal size and blanks the frame
+    void beginFrame();
+    unsigned int getColumns() const;
+    unsigned int getRows() const;
+
+    // glyph is a code point in the Basic Multilingual Plane
+    void set(unsigned int x, unsigned int y, uint16_t glyph, Color color);
+    void print(unsigned int x, unsigned int y, const char* text, Color color);
+
+    // writes cells that differ from what the terminal shows
+    void present();
+
+private:
+    struct Cell
+    {
+        uint16_t glyph;
+        uint8_t color;
+    };
+
+    // stands in for the buffer of a standard stream while open, without
+    // allocating
+    class Capture : public std::streambuf
+    {
+    public:
+        Capture(TerminalRenderer& renderer, std::ostream& stream);
+
+        void start();
+        // restores the stream and writes the kept lines to it
+        void stop();
+
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(const char* text, std::streamsize count)
+            override;
+
+    private:
+        TerminalRenderer& renderer;
+        std::ostream& stream;
+        std::streambuf* original;
+        char lines[TERMINAL_RENDERER_LOG_LINES][TERMINAL_RENDERER_LINE_LENGTH];
+        // lines ever finished, and length of the one being written
+        unsigned long lineCount;
+        std::size_t length;
+
+        // renderer's statusMutex must be locked
+        void put(char c);
+        void finishLine();
+    };
+
+    bool isOpen;
+    unsigned int columns;
+    unsigned int rows;
+    bool clearScreen;
+    int shownColor;
+    std::vector<Cell> frame;
+    std::vector<Cell> shown;
+    std::string colorSequences[COLOR_COUNT];
+    std::string output;
+
+    // guards the captures and the status
+    std::mutex statusMutex;
+    char status[TERMINAL_RENDERER_LINE_LENGTH];
+    std::chrono::steady_clock::time_point statusEnd;
+    Capture outCapture;
+    Capture errCapture;
+    Capture logCapture;
+
+    void appendGlyph(uint16_t glyph);
+    void write();
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+namespace MfPA
+{
+
+/*
+ * Passes the newest copy of a value from one writing thread to one reading
+ * thread without locking.
+ *
+ * The writer fills its own buffer and swaps it with the published one, the
+ * reader swaps the published one with its own only if it's newer, so
+ * neither ever waits and the reader never sees a partially written value.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() :
+    published(1),
+    written(0),
+    read(2)
+    {}
+
+    // only from the writing thread
+    T& getWriteBuffer()
+    {
+        return buffers[written];
+    }
+
+    // only from the writing thread, after filling getWriteBuffer()
+    void publish()
+    {
+        written = published.exchange(written | FRESH,
+            std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // only from the reading thread, newest published value or T() if
+    // nothing was published yet, valid until the next call
+    const T& acquire()
+    {
+        if(published.load(std::memory_order_relaxed) & FRESH)
+        {
+            read = published.exchange(read, std::memory_order_acq_rel)
+                & INDEX_MASK;
+        }
+        return buffers[read];
+    }
+
+private:
+    // set in the published index until the reader takes it
+    static const unsigned int FRESH = 4;
+    static const unsigned int INDEX_MASK = 3;
+
+    T buffers[3];
+    std::atomic<unsigned int> published;
+    unsigned int written;
+    unsigned int read;
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,200 @@
+#include "Vectorscope.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// sums of products of a channel pair into 4 independent partial sums, a
+// stride known at compile time (C != 0) lets the products be vectorized
+template <unsigned int C>
+void accumulate(
+    const float* pair,
+    std::size_t frames,
+    unsigned int channels,
+    float* sumLR,
+    float* sumLL,
+    float* sumRR)
+{
+    const unsigned int stride = C != 0 ? C : channels;
+    std::size_t frame = 0;
+    for(; frame + 4 <= frames; frame += 4)
+    {
+        for(unsigned int lane = 0; lane < 4; ++lane)
+        {
+            float l = pair[(frame + lane) * stride];
+            float r = pair[(frame + lane) * stride + 1];
+            sumLR[lane] += l * r;
+            sumLL[lane] += l * l;
+            sumRR[lane] += r * r;
+        }
+    }
+    for(; frame < frames; ++frame)
+    {
+        float l = pair[frame * stride];
+        float r = pair[frame * stride + 1];
+        sumLR[0] += l * r;
+        sumLL[0] += l * l;
+        sumRR[0] += r * r;
+    }
+}
+
+} // namespace
+
+MfPA::Vectorscope::Result::Result() :
+correlation(0.0f),
+pointCount(0)
+{}
+
+MfPA::Vectorscope::Vectorscope() :
+sampleRate(48000),
+channels(0),
+left(0),
+active(false),
+averageLR(0.0f),
+averageLL(0.0f),
+averageRR(0.0f),
+decimation(1),
+decimationCounter(0),
+pointCount(0),
+nextPoint(0)
+{}
+
+void MfPA::Vectorscope::configure(
+    unsigned int sampleRate,
+    unsigned char channels,
+    unsigned int pair,
+    unsigned int framerate)
+{
+    this->sampleRate = sampleRate > 0 ? sampleRate : 1;
+    this->channels = channels;
+    left = pair * 2;
+    active = left + 1 < channels;
+
+    averageLR = 0.0f;
+    averageLL = 0.0f;
+    averageRR = 0.0f;
+
+    // enough points for one frame, fewer if the sample rate is high
+    unsigned int pointsPerSecond = VECTORSCOPE_MAX_POINTS
+        * (framerate > 0 ? framerate : 60);
+    decimation = (this->sampleRate + pointsPerSecond - 1) / pointsPerSecond;
+    decimationCounter = 0;
+    pointCount = 0;
+    nextPoint = 0;
+}
+
+bool MfPA::Vectorscope::isActive() const
+{
+    return active;
+}
+
+void MfPA::Vectorscope::process(const float* samples, std::size_t frames)
+{
+    if(!active || frames == 0)
+    {
+        return;
+    }
+
+    float sumLR[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float sumLL[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float sumRR[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const float* pair = samples + left;
+    switch(channels)
+    {
+    case 2:
+        accumulate<2>(pair, frames, channels, sumLR, sumLL, sumRR);
+        break;
+    case 4:
+        accumulate<4>(pair, frames, channels, sumLR, sumLL, sumRR);
+        break;
+    case 6:
+        accumulate<6>(pair, frames, channels, sumLR, sumLL, sumRR);
+        break;
+    case 8:
+        accumulate<8>(pair, frames, channels, sumLR, sumLL, sumRR);
+        break;
+    default:
+        accumulate<0>(pair, frames, channels, sumLR, sumLL, sumRR);
+        break;
+    }
+
+    // one pole average over VECTORSCOPE_CORRELATION_TIME, applied per block
+    float keep = std::exp(
+        -(float)frames / (VECTORSCOPE_CORRELATION_TIME * sampleRate));
+    float add = (1.0f - keep) / frames;
+    averageLR = averageLR * keep
+        + (sumLR[0] + sumLR[1] + sumLR[2] + sumLR[3]) * add;
+    averageLL = averageLL * keep
+        + (sumLL[0] + sumLL[1] + sumLL[2] + sumLL[3]) * add;
+    averageRR = averageRR * keep
+        + (sumRR[0] + sumRR[1] + sumRR[2] + sumRR[3]) * add;
+
+    // rotate by 45 degrees so mono is vertical
+    for(std::size_t frame = (decimation - decimationCounter) % decimation;
+        frame < frames;
+        frame += decimation)
+    {
+        float l = pair[frame * channels];
+        float r = pair[frame * channels + 1];
+        pointsX[nextPoint] = (r - l) * 0.70710678f;
+        pointsY[nextPoint] = (l + r) * 0.70710678f;
+        nextPoint = (nextPoint + 1) % VECTORSCOPE_MAX_POINTS;
+        if(pointCount < VECTORSCOPE_MAX_POINTS)
+        {
+            ++pointCount;
+        }
+    }
+    decimationCounter = (decimationCounter + frames) % decimation;
+}
+
+const char* MfPA::Vectorscope::getName() const
+{
+    return "vectorscope";
+}
+
+void MfPA::Vectorscope::process(
+    const float* samples,
+    std::size_t frames,
+    unsigned char /* channels */)
+{
+    process(samples, frames);
+}
+
+void MfPA::Vectorscope::publish()
+{
+    // unrolled so the oldest point is first
+    Result& result = results.getWriteBuffer();
+    result.correlation = getCorrelation();
+    result.pointCount = pointCount;
+    std::size_t oldest =
+        (nextPoint + VECTORSCOPE_MAX_POINTS - pointCount)
+        % VECTORSCOPE_MAX_POINTS;
+    std::size_t first = std::min(pointCount, VECTORSCOPE_MAX_POINTS - oldest);
+    std::copy(pointsX + oldest, pointsX + oldest + first, result.pointsX);
+    std::copy(pointsY + oldest, pointsY + oldest + first, result.pointsY);
+    std::copy(pointsX, pointsX + pointCount - first, result.pointsX + first);
+    std::copy(pointsY, pointsY + pointCount - first, result.pointsY + first);
+    results.publish();
+}
+
+const MfPA::Vectorscope::Result& MfPA::Vectorscope::getResult()
+{
+    return results.acquire();
+}
+
+float MfPA::Vectorscope::getCorrelation() const
+{
+    float denominator = std::sqrt(averageLL * averageRR);
+    if(denominator < 1.0e-9f)
+    {
+        return 0.0f;
+    }
+    float correlation = averageLR / denominator;
+    if(correlation > 1.0f)
+    {
+        return 1.0f;
+    }
+    return correlation < -1.0f ? -1.0f : correlation;
+}
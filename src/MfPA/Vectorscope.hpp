@@ -0,0 +1,93 @@
+#ifndef VECTORSCOPE_HPP
+#define VECTORSCOPE_HPP
+
+// max points drawn each frame, older points fade out
+#define VECTORSCOPE_MAX_POINTS 2048
+// seconds over which correlation is averaged
+#define VECTORSCOPE_CORRELATION_TIME 0.3f
+
+#include <cstddef>
+
+#include "Analyzer.hpp"
+#include "TripleBuffer.hpp"
+
+namespace MfPA
+{
+
+/*
+ * Computes phase correlation and goniometer points of one channel pair of
+ * an interleaved float stream.
+ *
+ * Samples are decimated into a fixed ring of points so the cost of drawing
+ * does not depend on sample rate.
+ */
+class Vectorscope : public Analyzer
+{
+public:
+    struct Result
+    {
+        Result();
+
+        // -1 (out of phase) to 1 (in phase), 0 for silence
+        float correlation;
+        // point i of pointCount is the i-th oldest, x is side (right
+        // positive) and y is mid, both in [-1, 1] for full scale input
+        std::size_t pointCount;
+        float pointsX[VECTORSCOPE_MAX_POINTS];
+        float pointsY[VECTORSCOPE_MAX_POINTS];
+    };
+
+    Vectorscope();
+
+    // pair 0 is channels 0 and 1, pair 1 is channels 2 and 3, etc.
+    // resets correlation and points
+    void configure(
+        unsigned int sampleRate,
+        unsigned char channels,
+        unsigned int pair,
+        unsigned int framerate);
+
+    // false if the stream does not have the configured pair
+    bool isActive() const;
+
+    void process(const float* samples, std::size_t frames);
+
+    const char* getName() const override;
+    // always gets all channels, the configured channel count is used
+    void process(
+        const float* samples,
+        std::size_t frames,
+        unsigned char channels) override;
+    void publish() override;
+
+    // newest published result, only from one reading thread
+    const Result& getResult();
+
+private:
+    unsigned int sampleRate;
+    unsigned char channels;
+    unsigned int left;
+    bool active;
+
+    // running averages of left * right, left^2, and right^2
+    float averageLR;
+    float averageLL;
+    float averageRR;
+
+    // keep every decimation-th frame as a point
+    unsigned int decimation;
+    unsigned int decimationCounter;
+    float pointsX[VECTORSCOPE_MAX_POINTS];
+    float pointsY[VECTORSCOPE_MAX_POINTS];
+    std::size_t pointCount;
+    std::size_t nextPoint;
+
+    TripleBuffer<Result> results;
+
+    float getCorrelation() const;
+
+};
+
+} // namespace MfPA
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * Feeds synthetic blocks through everything that runs per block, on the
+ * updating thread and on the analysis pipeline, and fails if anything
+ * allocates once warmed up. A subscriber of the level server asks for
+ * statistics now and then and checks the records it receives.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "MfPA/AllocationAudit.hpp"
+#include "MfPA/AnalysisPipeline.hpp"
+#include "MfPA/Analyzer.hpp"
+#include "MfPA/EventDetector.hpp"
+#include "MfPA/LevelServer.hpp"
+#include "MfPA/LevelStatistics.hpp"
+#include "MfPA/PeakAnalyzer.hpp"
+#include "MfPA/Vectorscope.hpp"
+
+#define TEST_SAMPLE_RATE 48000
+#define TEST_CHANNELS 2
+#define TEST_BLOCK_FRAMES 480
+// blocks per phase, 2 seconds each
+#define TEST_BLOCKS 200
+
+namespace
+{
+
+struct Harness
+{
+    MfPA::PeakAnalyzer peakAnalyzer;
+    MfPA::Vectorscope vectorscope;
+    MfPA::AnalyzerChain analyzers;
+    MfPA::AnalysisPipeline pipeline;
+    MfPA::EventDetector events;
+    MfPA::LevelStatistics statistics;
+    MfPA::LevelServer levelServer;
+    MfPA::LevelStatistics::Percentiles percentiles[TEST_CHANNELS];
+    int subscriber;
+    // received by the subscriber but not yet a whole record
+    std::vector<char> received;
+    unsigned long statisticsRecords;
+    bool badRecord;
+    std::vector<float> block;
+    float levelValues[TEST_CHANNELS * 2];
+    unsigned long blockIndex;
+};
+
+// a tone that is silent for a while and clips now and then, so events fire
+void fillBlock(Harness& harness)
+{
+    unsigned long second = harness.blockIndex * TEST_BLOCK_FRAMES
+        / TEST_SAMPLE_RATE;
+    float amplitude = second % 4 == 3 ? 0.0f
+        : harness.blockIndex % 50 == 0 ? 1.0f : 0.5f;
+    for(unsigned int frame = 0; frame < TEST_BLOCK_FRAMES; ++frame)
+    {
+        float phase = (float)(harness.blockIndex * TEST_BLOCK_FRAMES + frame)
+            * 2.0f * 3.14159265f * 440.0f / TEST_SAMPLE_RATE;
+        for(unsigned int channel = 0; channel < TEST_CHANNELS; ++channel)
+        {
+            harness.block[frame * TEST_CHANNELS + channel] =
+                amplitude * std::sin(phase + channel);
+        }
+    }
+    ++harness.blockIndex;
+}
+
+// what the meter does for every captured block in one update
+void runBlock(Harness& harness, bool usePipeline)
+{
+    fillBlock(harness);
+
+    MfPA::AllocationAudit::Scope auditScope(MfPA::AllocationAudit::UPDATE);
+    harness.levelServer.poll();
+    if(harness.levelServer.takeStatisticsRequest())
+    {
+        harness.statistics.requestSnapshot();
+    }
+    float coveredSeconds;
+    if(harness.statistics.takeSnapshot(harness.percentiles, coveredSeconds))
+    {
+        harness.levelServer.publishStatistics(
+            (const float*) harness.percentiles, TEST_CHANNELS);
+    }
+    if(usePipeline)
+    {
+        while(!harness.pipeline.push(
+            harness.block.data(), harness.block.size()))
+        {
+            std::this_thread::yield();
+        }
+    }
+    else
+    {
+        harness.analyzers.process(
+            harness.block.data(), TEST_BLOCK_FRAMES, TEST_CHANNELS);
+        harness.analyzers.publish();
+    }
+
+    const MfPA::PeakAnalyzer::Result& peaks =
+        harness.peakAnalyzer.getResult();
+    for(unsigned int channel = 0; channel < TEST_CHANNELS; ++channel)
+    {
+        harness.levelValues[channel * 2] = peaks.levels[channel];
+        harness.levelValues[channel * 2 + 1] = peaks.holds[channel];
+    }
+    harness.levelServer.publish(harness.levelValues, TEST_CHANNELS);
+    harness.vectorscope.getResult();
+}
+
+// checks that records arrive whole and counts statistics records
+void drainSubscriber(Harness& harness)
+{
+    char buffer[4096];
+    ssize_t n;
+    while((n = recv(harness.subscriber, buffer, sizeof(buffer), MSG_DONTWAIT))
+        > 0)
+    {
+        harness.received.insert(harness.received.end(), buffer, buffer + n);
+    }
+
+    std::size_t offset = 0;
+    while(harness.received.size() - offset >= LEVEL_SERVER_RECORD_HEADER_SIZE)
+    {
+        const char* record = harness.received.data() + offset;
+        uint32_t magic;
+        uint16_t channels;
+        uint16_t flags;
+        std::memcpy(&magic, record, sizeof(magic));
+        std::memcpy(&channels, record + 16, sizeof(channels));
+        std::memcpy(&flags, record + 18, sizeof(flags));
+        if(magic != LEVEL_SERVER_RECORD_MAGIC || channels != TEST_CHANNELS)
+        {
+            harness.badRecord = true;
+            harness.received.clear();
+            return;
+        }
+        std::size_t size = LEVEL_SERVER_RECORD_HEADER_SIZE + channels
+            * (flags & LEVEL_SERVER_FLAG_STATISTICS ? 4 : 2) * sizeof(float);
+        if(harness.received.size() - offset < size)
+        {
+            break;
+        }
+        if(flags & LEVEL_SERVER_FLAG_STATISTICS)
+        {
+            ++harness.statisticsRecords;
+        }
+        offset += size;
+    }
+    harness.received.erase(
+        harness.received.begin(), harness.received.begin() + offset);
+}
+
+void runBlocks(Harness& harness, bool usePipeline)
+{
+    for(unsigned int i = 0; i < TEST_BLOCKS; ++i)
+    {
+        if(i % 50 == 0)
+        {
+            send(harness.subscriber, "statistics\n", 11, MSG_NOSIGNAL);
+        }
+        runBlock(harness, usePipeline);
+        drainSubscriber(harness);
+    }
+    // let the pipeline finish before the phase ends
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+} // namespace
+
+int main()
+{
+    char directory[] = "/tmp/MfPA-AllocationTest-XXXXXX";
+    if(!mkdtemp(directory))
+    {
+        std::cerr << "ERROR: Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    std::string eventsPath = std::string(directory) + "/events.log";
+    std::string socketPath = std::string(directory) + "/levels.sock";
+
+    int result = 0;
+    {
+        Harness harness;
+        harness.block.resize(TEST_BLOCK_FRAMES * TEST_CHANNELS);
+        harness.blockIndex = 0;
+        harness.statisticsRecords = 0;
+        harness.badRecord = false;
+
+        harness.peakAnalyzer.getBallistics().configure(
+            TEST_SAMPLE_RATE, TEST_CHANNELS);
+        harness.vectorscope.configure(
+            TEST_SAMPLE_RATE, TEST_CHANNELS, 0, 60);
+        harness.analyzers.add(&harness.peakAnalyzer);
+        harness.analyzers.add(&harness.vectorscope);
+
+        if(!harness.events.open(
+            "file:" + eventsPath, MfPA::EventDetector::Thresholds()))
+        {
+            return 1;
+        }
+        harness.events.setDevice("test");
+        harness.events.setChannels(TEST_CHANNELS);
+        harness.statistics.configure(TEST_CHANNELS, 60.0f);
+        harness.peakAnalyzer.setBlockCallback(
+            [&harness] (const float* peaks, std::size_t frames) {
+                float seconds = (float)frames / TEST_SAMPLE_RATE;
+                harness.events.process(peaks, seconds);
+                harness.statistics.process(peaks, seconds);
+            });
+
+        if(!harness.levelServer.listen(socketPath.c_str()))
+        {
+            return 1;
+        }
+        harness.subscriber = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address = sockaddr_un();
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s",
+            socketPath.c_str());
+        if(connect(harness.subscriber, (const sockaddr*) &address,
+            sizeof(sockaddr_un)) != 0)
+        {
+            std::cerr << "ERROR: Failed to subscribe to level server"
+                << std::endl;
+            return 1;
+        }
+
+        // both ways of analyzing warm up before anything counts
+        runBlocks(harness, false);
+        harness.pipeline.start(2, &harness.analyzers, TEST_CHANNELS);
+        runBlocks(harness, true);
+        MfPA::AllocationAudit::endWarmUp();
+
+        runBlocks(harness, true);
+        harness.pipeline.stop();
+        runBlocks(harness, false);
+
+        MfPA::AllocationAudit::report(std::cout);
+        uint64_t steadyState =
+            MfPA::AllocationAudit::getSteadyStateAllocations();
+        if(steadyState > 0)
+        {
+            std::cerr << "ERROR: " << steadyState
+                << " allocations after warm-up" << std::endl;
+            result = 1;
+        }
+        if(harness.badRecord || harness.statisticsRecords == 0)
+        {
+            std::cerr << "ERROR: Level server records were garbled or no "
+                "statistics were answered" << std::endl;
+            result = 1;
+        }
+        close(harness.subscriber);
+    }
+
+    std::remove(eventsPath.c_str());
+    rmdir(directory);
+    return result;
+}
@@ -0,0 +1,276 @@
+/*
+ * Records a clip and a request from synthetic blocks whose samples encode
+ * their frame number, and checks the WAV header, that the files cover
+ * exactly pre-roll before and post-roll after each trigger, and that both
+ * recordings get their own file.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "MfPA/BlackBoxRecorder.hpp"
+
+#define TEST_SAMPLE_RATE 8000
+#define TEST_CHANNELS 2
+#define TEST_BLOCK_FRAMES 200
+#define TEST_PRE_ROLL 0.5f
+#define TEST_POST_ROLL 0.25f
+#define TEST_HEADER_SIZE 58
+
+namespace
+{
+
+// exact for frames below 2^24, and below the clip level
+float encode(uint64_t frame, unsigned int channel)
+{
+    float value = (float)frame / 16777216.0f;
+    return channel == 0 ? value : -value;
+}
+
+uint16_t getUint16(const unsigned char* bytes)
+{
+    return bytes[0] | bytes[1] << 8;
+}
+
+uint32_t getUint32(const unsigned char* bytes)
+{
+    return getUint16(bytes) | (uint32_t)getUint16(bytes + 2) << 16;
+}
+
+bool fail(const std::string& message)
+{
+    std::cerr << "ERROR: " << message << std::endl;
+    return false;
+}
+
+class Feeder
+{
+public:
+    Feeder(MfPA::BlackBoxRecorder& recorder) :
+    recorder(recorder),
+    frame(0),
+    block(TEST_BLOCK_FRAMES * TEST_CHANNELS)
+    {}
+
+    // returns the frame count after the block, which is where a trigger
+    // in it is placed
+    uint64_t feed(bool clip)
+    {
+        for(unsigned int i = 0; i < TEST_BLOCK_FRAMES; ++i)
+        {
+            for(unsigned int channel = 0; channel < TEST_CHANNELS; ++channel)
+            {
+                block[i * TEST_CHANNELS + channel] =
+                    encode(frame + i, channel);
+            }
+        }
+        if(clip)
+        {
+            block[0] = 1.0f;
+        }
+        recorder.process(block.data(), TEST_BLOCK_FRAMES, TEST_CHANNELS);
+        frame += TEST_BLOCK_FRAMES;
+        return frame;
+    }
+
+    void feedSeconds(float seconds)
+    {
+        for(float fed = 0.0f; fed < seconds;
+            fed += (float)TEST_BLOCK_FRAMES / TEST_SAMPLE_RATE)
+        {
+            feed(false);
+        }
+    }
+
+private:
+    MfPA::BlackBoxRecorder& recorder;
+    uint64_t frame;
+    std::vector<float> block;
+};
+
+bool waitForRecordings(MfPA::BlackBoxRecorder& recorder, unsigned long count)
+{
+    for(unsigned int i = 0; i < 100 && recorder.getRecordings() < count; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return recorder.getRecordings() == count;
+}
+
+bool checkRecording(const std::string& path, uint64_t triggerFrame)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if(!file)
+    {
+        return fail("Failed to open " + path);
+    }
+    unsigned char header[TEST_HEADER_SIZE];
+    bool readHeader = std::fread(header, sizeof(header), 1, file) == 1;
+    std::vector<float> samples;
+    float sample;
+    while(std::fread(&sample, sizeof(float), 1, file) == 1)
+    {
+        samples.push_back(sample);
+    }
+    std::fclose(file);
+    if(!readHeader)
+    {
+        return fail("Missing header in " + path);
+    }
+
+    const uint64_t preRollFrames = (uint64_t)(TEST_PRE_ROLL * TEST_SAMPLE_RATE);
+    const uint64_t postRollFrames =
+        (uint64_t)(TEST_POST_ROLL * TEST_SAMPLE_RATE);
+    const uint64_t frames = preRollFrames + postRollFrames;
+    const uint32_t dataSize = frames * TEST_CHANNELS * sizeof(float);
+    if(std::memcmp(header, "RIFF", 4) != 0
+        || getUint32(header + 4) != TEST_HEADER_SIZE - 8 + dataSize
+        || std::memcmp(header + 8, "WAVE", 4) != 0
+        || std::memcmp(header + 12, "fmt ", 4) != 0
+        || getUint32(header + 16) != 18
+        // WAVE_FORMAT_IEEE_FLOAT
+        || getUint16(header + 20) != 3
+        || getUint16(header + 22) != TEST_CHANNELS
+        || getUint32(header + 24) != TEST_SAMPLE_RATE
+        || getUint32(header + 28)
+            != TEST_SAMPLE_RATE * TEST_CHANNELS * sizeof(float)
+        || getUint16(header + 32) != TEST_CHANNELS * sizeof(float)
+        || getUint16(header + 34) != 32
+        || getUint16(header + 36) != 0
+        || std::memcmp(header + 38, "fact", 4) != 0
+        || getUint32(header + 42) != 4
+        || getUint32(header + 46) != frames
+        || std::memcmp(header + 50, "data", 4) != 0
+        || getUint32(header + 54) != dataSize)
+    {
+        return fail("Wrong header in " + path);
+    }
+
+    if(samples.size() != frames * TEST_CHANNELS)
+    {
+        return fail("Wrong amount of samples in " + path);
+    }
+    const uint64_t startFrame = triggerFrame - preRollFrames;
+    for(uint64_t i = 0; i < frames; ++i)
+    {
+        for(unsigned int channel = 0; channel < TEST_CHANNELS; ++channel)
+        {
+            float value = samples[i * TEST_CHANNELS + channel];
+            // the clipped sample
+            if(value == 1.0f)
+            {
+                continue;
+            }
+            if(value != encode(startFrame + i, channel))
+            {
+                return fail("Wrong frame " + std::to_string(i) + " in " + path);
+            }
+        }
+    }
+    return true;
+}
+
+// file names sorted by the number of their recording
+std::vector<std::string> listRecordings(const char* directory)
+{
+    std::vector<std::string> names;
+    DIR* dir = opendir(directory);
+    if(!dir)
+    {
+        return names;
+    }
+    while(dirent* entry = readdir(dir))
+    {
+        if(std::strncmp(entry->d_name, "blackbox-", 9) == 0)
+        {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    if(names.size() == 2 && names[0].find("-2-") != std::string::npos)
+    {
+        std::swap(names[0], names[1]);
+    }
+    return names;
+}
+
+} // namespace
+
+int main()
+{
+    char directory[] = "/tmp/MfPA-BlackBoxRecorderTest-XXXXXX";
+    if(!mkdtemp(directory))
+    {
+        std::cerr << "ERROR: Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+
+    bool passed = true;
+    std::vector<std::string> names;
+    {
+        MfPA::BlackBoxRecorder recorder;
+        MfPA::BlackBoxRecorder::Settings settings;
+        settings.directory = directory;
+        settings.preRoll = TEST_PRE_ROLL;
+        settings.postRoll = TEST_POST_ROLL;
+        // samples near frame 0 are quiet, but must not count as silence
+        settings.silenceThreshold = -200.0f;
+        if(!recorder.open(settings))
+        {
+            return 1;
+        }
+        recorder.configure(TEST_SAMPLE_RATE, TEST_CHANNELS);
+
+        // more than the ring holds, so the pre-roll wraps around it
+        Feeder feeder(recorder);
+        feeder.feedSeconds(3.0f);
+        uint64_t clipFrame = feeder.feed(true);
+        feeder.feedSeconds(TEST_POST_ROLL + 0.1f);
+        passed = waitForRecordings(recorder, 1)
+            || fail("Clip was not recorded");
+
+        // within the same second, so only the number tells them apart
+        recorder.requestTrigger();
+        uint64_t requestFrame = feeder.feed(false);
+        feeder.feedSeconds(TEST_POST_ROLL + 0.1f);
+        passed = (waitForRecordings(recorder, 2)
+            || fail("Request was not recorded")) && passed;
+        recorder.stopWriter();
+
+        names = listRecordings(directory);
+        if(names.size() != 2
+            || names[0].find("-1-clip.wav") == std::string::npos
+            || names[1].find("-2-request.wav") == std::string::npos)
+        {
+            passed = fail("Expected one clip and one request recording");
+        }
+        else
+        {
+            passed = checkRecording(
+                std::string(directory) + "/" + names[0], clipFrame) && passed;
+            passed = checkRecording(
+                std::string(directory) + "/" + names[1], requestFrame)
+                && passed;
+        }
+        if(recorder.getTruncatedRecordings() > 0)
+        {
+            passed = fail("Recordings were cut short");
+        }
+    }
+
+    for(const auto& name : names)
+    {
+        std::remove((std::string(directory) + "/" + name).c_str());
+    }
+    rmdir(directory);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+/*
+ * Stand-in subscribers of the level server: one asks for every 4th record,
+ * one reads only now and then and must see its queued records coalesced,
+ * and one stops reading and must be dropped without publish ever
+ * blocking.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "MfPA/LevelServer.hpp"
+
+// large records fill a socket buffer after a few dozen publishes
+#define TEST_CHANNELS 255
+#define TEST_DECIMATION 4
+// publishes between reads of the slow subscriber, more than fill its socket
+// and fewer than get it dropped
+#define TEST_SLOW_READ_INTERVAL 150
+// seconds a publish may take, it must never wait for a subscriber
+#define TEST_MAX_PUBLISH_TIME 0.05
+
+namespace
+{
+
+bool fail(const std::string& message)
+{
+    std::cerr << "ERROR: " << message << std::endl;
+    return false;
+}
+
+class Subscriber
+{
+public:
+    Subscriber() :
+    fd(-1),
+    disconnected(false),
+    badRecord(false)
+    {}
+
+    ~Subscriber()
+    {
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    bool connect(const std::string& path)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address = sockaddr_un();
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s",
+            path.c_str());
+        return fd >= 0 && ::connect(fd, (const sockaddr*) &address,
+            sizeof(sockaddr_un)) == 0;
+    }
+
+    void request(const char* line)
+    {
+        send(fd, line, std::strlen(line), MSG_NOSIGNAL);
+    }
+
+    // reads everything available, collecting sequences of whole records
+    void read()
+    {
+        char buffer[65536];
+        ssize_t n;
+        while((n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        {
+            received.insert(received.end(), buffer, buffer + n);
+        }
+        if(n == 0)
+        {
+            disconnected = true;
+        }
+
+        std::size_t offset = 0;
+        const std::size_t size = LEVEL_SERVER_RECORD_HEADER_SIZE
+            + TEST_CHANNELS * 2 * sizeof(float);
+        while(received.size() - offset >= size)
+        {
+            uint32_t magic;
+            uint32_t sequence;
+            uint16_t channels;
+            std::memcpy(&magic, received.data() + offset, 4);
+            std::memcpy(&sequence, received.data() + offset + 4, 4);
+            std::memcpy(&channels, received.data() + offset + 16, 2);
+            if(magic != LEVEL_SERVER_RECORD_MAGIC || channels != TEST_CHANNELS)
+            {
+                badRecord = true;
+                break;
+            }
+            sequences.push_back(sequence);
+            offset += size;
+        }
+        received.erase(received.begin(), received.begin() + offset);
+    }
+
+    int fd;
+    bool disconnected;
+    bool badRecord;
+    std::vector<char> received;
+    std::vector<uint32_t> sequences;
+};
+
+// publishes once, returns false if that took too long
+bool publish(MfPA::LevelServer& server, const float* values)
+{
+    auto start = std::chrono::steady_clock::now();
+    server.poll();
+    server.publish(values, TEST_CHANNELS);
+    return std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - start).count()
+        < TEST_MAX_PUBLISH_TIME;
+}
+
+bool testDecimation(MfPA::LevelServer& server, const float* values,
+    const std::string& path)
+{
+    Subscriber subscriber;
+    if(!subscriber.connect(path))
+    {
+        return fail("Failed to connect decimating subscriber");
+    }
+    subscriber.request("decimate 4\n");
+    server.poll();
+    for(unsigned int i = 0; i < 40 * TEST_DECIMATION; ++i)
+    {
+        publish(server, values);
+        subscriber.read();
+    }
+
+    if(subscriber.badRecord || subscriber.sequences.size() != 40)
+    {
+        return fail("Decimating subscriber got "
+            + std::to_string(subscriber.sequences.size())
+            + " records instead of 40");
+    }
+    for(std::size_t i = 1; i < subscriber.sequences.size(); ++i)
+    {
+        if(subscriber.sequences[i] - subscriber.sequences[i - 1]
+            != TEST_DECIMATION)
+        {
+            return fail("Decimated records are not every 4th");
+        }
+    }
+    return true;
+}
+
+bool testCoalescing(MfPA::LevelServer& server, const float* values,
+    const std::string& path)
+{
+    Subscriber subscriber;
+    if(!subscriber.connect(path))
+    {
+        return fail("Failed to connect slow subscriber");
+    }
+    server.poll();
+    bool fast = true;
+    for(unsigned int i = 0; i < 10 * TEST_SLOW_READ_INTERVAL; ++i)
+    {
+        fast = publish(server, values) && fast;
+        if(i % TEST_SLOW_READ_INTERVAL == TEST_SLOW_READ_INTERVAL - 1)
+        {
+            subscriber.read();
+        }
+    }
+    subscriber.read();
+
+    bool coalesced = false;
+    for(std::size_t i = 1; i < subscriber.sequences.size(); ++i)
+    {
+        uint32_t step = subscriber.sequences[i] - subscriber.sequences[i - 1];
+        if(step == 0 || step > 10 * TEST_SLOW_READ_INTERVAL)
+        {
+            return fail("Slow subscriber got records out of order");
+        }
+        coalesced = coalesced || step > 1;
+    }
+    if(subscriber.badRecord || subscriber.disconnected)
+    {
+        return fail("Slow subscriber got garbled records or was dropped");
+    }
+    if(!coalesced)
+    {
+        return fail("Records of slow subscriber were not coalesced");
+    }
+    return fast || fail("Publishing waited for slow subscriber");
+}
+
+bool testStalled(MfPA::LevelServer& server, const float* values,
+    const std::string& path)
+{
+    Subscriber subscriber;
+    if(!subscriber.connect(path))
+    {
+        return fail("Failed to connect stalled subscriber");
+    }
+    server.poll();
+    bool fast = true;
+    for(unsigned int i = 0; i < 4 * LEVEL_SERVER_MAX_STALLED_PUBLISHES; ++i)
+    {
+        fast = publish(server, values) && fast;
+    }
+
+    // queued records are still readable, then the connection ends
+    for(unsigned int i = 0; i < 100 && !subscriber.disconnected; ++i)
+    {
+        subscriber.read();
+    }
+    if(!subscriber.disconnected)
+    {
+        return fail("Stalled subscriber was not dropped");
+    }
+    if(subscriber.badRecord)
+    {
+        return fail("Stalled subscriber got garbled records");
+    }
+    return fast || fail("Publishing waited for stalled subscriber");
+}
+
+} // namespace
+
+int main()
+{
+    char directory[] = "/tmp/MfPA-LevelServerTest-XXXXXX";
+    if(!mkdtemp(directory))
+    {
+        std::cerr << "ERROR: Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    std::string socketPath = std::string(directory) + "/levels.sock";
+
+    bool passed;
+    {
+        MfPA::LevelServer server;
+        if(!server.listen(socketPath.c_str()))
+        {
+            return 1;
+        }
+        std::vector<float> values(TEST_CHANNELS * 2, 0.5f);
+
+        passed = testDecimation(server, values.data(), socketPath);
+        passed = testCoalescing(server, values.data(), socketPath) && passed;
+        passed = testStalled(server, values.data(), socketPath) && passed;
+    }
+
+    rmdir(directory);
+    return passed ? 0 : 1;
+}